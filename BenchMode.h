@@ -0,0 +1,234 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "GpuTimers.h"
+#include "Vertex.h"
+
+// ---------------
+// Headless benchmark mode
+// ---------------
+//
+// With --bench, the window stays hidden and every frame is rendered into an offscreen
+// framebuffer at a fixed resolution, with the camera following a scripted orbit. After
+// the requested number of frames, the results are printed as JSON and the program exits.
+// On machines without a display, --bench-context osmesa (or egl) selects a context that
+// does not need one, as long as GLFW was built with that backend.
+
+/**
+ * Context creation backends selectable for the benchmark
+ */
+enum BenchContext
+{
+	BENCH_CONTEXT_NATIVE = 0,	// Whatever the platform uses by default (GLX, WGL, ...)
+	BENCH_CONTEXT_EGL,
+	BENCH_CONTEXT_OSMESA		// Software rendering without any display, through Mesa
+};
+
+/**
+ * Struct containing the offscreen framebuffer the benchmark renders into
+ */
+struct BenchTarget
+{
+	GLuint fbo = 0;
+	GLuint color = 0;
+	GLuint depth = 0;
+	int width = 0;
+	int height = 0;
+};
+
+/**
+ * @brief Parses the name of a context creation backend.
+ * @param[in] name "native", "egl" or "osmesa"
+ * @param[out] context Parsed backend
+ * @return True if the name is known, false otherwise
+ */
+inline bool ParseBenchContext(const std::string& name, BenchContext& context)
+{
+	if (name == "native")
+	{
+		context = BENCH_CONTEXT_NATIVE;
+	}
+	else if (name == "egl")
+	{
+		context = BENCH_CONTEXT_EGL;
+	}
+	else if (name == "osmesa")
+	{
+		context = BENCH_CONTEXT_OSMESA;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Sets the GLFW init hints needed by a backend. Call before glfwInit().
+ * @param[in] context Context creation backend
+ */
+inline void SetBenchInitHints(BenchContext context)
+{
+#ifdef GLFW_PLATFORM_NULL
+	// GLFW 3.4 can run without any windowing system, which OSMesa does not need
+	if (context == BENCH_CONTEXT_OSMESA)
+	{
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	}
+#else
+	(void)context;
+#endif
+}
+
+/**
+ * @brief Sets the GLFW window hints of the hidden benchmark window. Call before glfwCreateWindow().
+ * @param[in] context Context creation backend
+ */
+inline void SetBenchWindowHints(BenchContext context)
+{
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	if (context == BENCH_CONTEXT_EGL)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+	}
+	else if (context == BENCH_CONTEXT_OSMESA)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
+}
+
+/**
+ * @brief Creates the offscreen framebuffer, with a color and a depth renderbuffer.
+ * @param[in] width Width of the framebuffer
+ * @param[in] height Height of the framebuffer
+ * @param[out] target Created framebuffer
+ * @return True if the framebuffer is complete, false otherwise
+ */
+inline bool CreateBenchTarget(int width, int height, BenchTarget& target)
+{
+	target.width = width;
+	target.height = height;
+
+	glGenRenderbuffers(1, &target.color);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &target.depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, target.depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &target.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depth);
+
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+/**
+ * @brief Deletes the offscreen framebuffer and its renderbuffers.
+ * @param[in,out] target Framebuffer to delete
+ */
+inline void DeleteBenchTarget(BenchTarget& target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &target.fbo);
+	glDeleteRenderbuffers(1, &target.color);
+	glDeleteRenderbuffers(1, &target.depth);
+	target = BenchTarget();
+}
+
+/**
+ * @brief Gets the camera position of a benchmark frame. The camera does one full orbit
+ * around the shrine over the benchmark, bobbing up and down twice.
+ * @param[in] frame Index of the frame
+ * @param[in] frameCount Number of frames of the benchmark
+ * @return Position of the camera
+ */
+inline glm::vec3 GetBenchCameraPosition(int frame, int frameCount)
+{
+	float t = static_cast<float>(frame) / static_cast<float>(std::max(1, frameCount));
+	float angle = t * 2.0f * 3.14159265f;
+	return glm::vec3(std::sin(angle) * 30.0f, 12.0f + std::sin(angle * 2.0f) * 4.0f, std::cos(angle) * 30.0f);
+}
+
+/**
+ * @brief Gets the point the camera looks at during the benchmark.
+ * @return Target of the camera
+ */
+inline glm::vec3 GetBenchCameraTarget()
+{
+	return glm::vec3(0.0f, 4.0f, -2.0f);
+}
+
+/**
+ * @brief Computes the average and the 99th percentile of a list of frame times.
+ * @param[in] times Frame times in milliseconds
+ * @param[out] avg Average frame time
+ * @param[out] p99 99th percentile of the frame times
+ */
+inline void GetFrameTimeStats(std::vector<float> times, float& avg, float& p99)
+{
+	avg = 0.0f;
+	p99 = 0.0f;
+	if (times.empty())
+	{
+		return;
+	}
+
+	std::sort(times.begin(), times.end());
+	for (float time : times)
+	{
+		avg += time;
+	}
+	avg /= times.size();
+	p99 = times[std::min(times.size() - 1, times.size() * 99 / 100)];
+}
+
+/**
+ * @brief Prints the results of the benchmark as JSON on stdout.
+ * @param[in] target Framebuffer the benchmark rendered into
+ * @param[in] frameCount Number of frames rendered
+ * @param[in] seconds Wall time spent rendering, including the final glFinish()
+ * @param[in] cpuFrameTimes CPU time spent on each frame, in milliseconds
+ * @param[in] timers GPU timers of the render passes
+ * @param[in] vertexLayout Layout the meshes were uploaded in
+ * @param[in] vertexCount Number of vertices uploaded, across all meshes
+ */
+inline void PrintBenchReport(const BenchTarget& target, int frameCount, double seconds, const std::vector<float>& cpuFrameTimes, const GpuTimers& timers,
+	VertexLayout vertexLayout, size_t vertexCount)
+{
+	float cpuAvg, cpuP99;
+	GetFrameTimeStats(cpuFrameTimes, cpuAvg, cpuP99);
+
+	std::printf("{\n");
+	std::printf("  \"renderer\": \"%s\",\n", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+	std::printf("  \"width\": %d,\n", target.width);
+	std::printf("  \"height\": %d,\n", target.height);
+	std::printf("  \"frames\": %d,\n", frameCount);
+	std::printf("  \"seconds\": %.4f,\n", seconds);
+	std::printf("  \"fps\": %.2f,\n", seconds > 0.0 ? frameCount / seconds : 0.0);
+	std::printf("  \"vertex_layout\": \"%s\",\n", vertexLayout == VERTEX_LAYOUT_PACKED ? "packed" : "float");
+	std::printf("  \"vertex_bytes\": { \"stride\": %zu, \"total\": %zu },\n", GetVertexSize(vertexLayout), GetVertexSize(vertexLayout) * vertexCount);
+	std::printf("  \"cpu_ms\": { \"avg\": %.4f, \"p99\": %.4f },\n", cpuAvg, cpuP99);
+	std::printf("  \"gpu_ms\": {");
+	for (size_t i = 0; i < timers.scopes.size(); i++)
+	{
+		GpuTimerStats stats = GetGpuTimerStats(timers.scopes[i]);
+		std::printf("%s\n    \"%s\": { \"min\": %.4f, \"avg\": %.4f, \"p99\": %.4f, \"samples\": %zu }",
+			i == 0 ? "" : ",", timers.scopes[i].name.c_str(), stats.min, stats.avg, stats.p99, stats.sampleCount);
+	}
+	std::printf("\n  }\n}\n");
+	std::fflush(stdout);
+}
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "GLState.h"
+#include "Scene.h"
+
+// ---------------
+// Clustered forward lighting
+// ---------------
+//
+// The view frustum is split into CLUSTER_COUNT_X x CLUSTER_COUNT_Y screen tiles and
+// CLUSTER_COUNT_Z depth slices, spaced exponentially so that clusters stay roughly cubic.
+// Every frame, the CPU finds the clusters each point light's sphere of influence touches
+// and builds, per cluster, the list of lights to shade with. main.fsh then only loops over
+// the lights of the cluster its fragment falls in.
+//
+// OpenGL 3.3 has neither storage buffers nor compute shaders, so the three arrays go to
+// the shader as buffer textures:
+//   lightData     RGBA32F  CLUSTER_LIGHT_TEXELS texels per light, see PackPointLight()
+//   clusterGrid   RG32UI   per cluster, offset and count of its run in lightIndices
+//   lightIndices  R32UI    light indices of every cluster, back to back
+
+const int CLUSTER_COUNT_X = 16;
+const int CLUSTER_COUNT_Y = 9;
+const int CLUSTER_COUNT_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+const int CLUSTER_LIGHT_TEXELS = 4;
+
+// Texture units of the buffer textures, after the material array
+const GLuint LIGHT_DATA_TEXTURE_UNIT = 1;
+const GLuint CLUSTER_GRID_TEXTURE_UNIT = 2;
+const GLuint LIGHT_INDEX_TEXTURE_UNIT = 3;
+
+/**
+ * Struct containing a point light, with the same parameters as a scene light
+ */
+struct PointLight
+{
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 ambient = glm::vec3(0.0f);
+	glm::vec3 diffuse = glm::vec3(0.0f);
+	glm::vec3 specular = glm::vec3(0.0f);	// Already multiplied by the light's specComp
+	float constant = 1.0f;
+	float linear = 0.0f;
+	float quadratic = 0.0f;
+	float radius = 0.0f;					// Distance past which the light is ignored
+};
+
+/**
+ * Struct containing the light and cluster buffers, and the CPU side of the cluster assignment
+ */
+struct ClusterGrid
+{
+	GLuint lightBuffer = 0;
+	GLuint lightTexture = 0;
+	GLuint gridBuffer = 0;
+	GLuint gridTexture = 0;
+	GLuint indexBuffer = 0;
+	GLuint indexTexture = 0;
+
+	float nearPlane = 0.1f;
+	float farPlane = 100.0f;
+
+	// View-space bounds of every cluster, as (x, y, depth) with depth = -z.
+	// Rebuilt only when the projection changes.
+	std::vector<glm::vec3> boundsMin;
+	std::vector<glm::vec3> boundsMax;
+	float boundsFov = 0.0f;
+	float boundsAspect = 0.0f;
+
+	// Staging data of the three buffers
+	std::vector<glm::vec4> lightTexels;
+	std::vector<uint32_t> grid;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> lightClusters;	// Scratch: for every light, its clusters, with a count in front
+
+	// Statistics of the last assignment
+	uint32_t lightCount = 0;
+	uint32_t maxClusterLights = 0;
+};
+
+/**
+ * @brief Computes the distance at which a light's attenuated contribution drops below 1/256.
+ * @param[in] light Point light
+ * @return Radius of the light's sphere of influence
+ */
+inline float GetPointLightRadius(const PointLight& light)
+{
+	glm::vec3 brightest = glm::max(light.ambient, glm::max(light.diffuse, light.specular));
+	float intensity = std::max(brightest.x, std::max(brightest.y, brightest.z));
+	float target = intensity * 256.0f - light.constant;
+	if (target <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	// Solve constant + linear * d + quadratic * d^2 = intensity * 256
+	if (light.quadratic > 0.0f)
+	{
+		return (-light.linear + std::sqrt(light.linear * light.linear + 4.0f * light.quadratic * target)) / (2.0f * light.quadratic);
+	}
+	if (light.linear > 0.0f)
+	{
+		return target / light.linear;
+	}
+	return 1e30f;
+}
+
+/**
+ * @brief Creates a point light from a scene light.
+ * @param[in] record Scene light of type SCENE_LIGHT_POINT
+ * @return Point light with its radius computed
+ */
+inline PointLight MakePointLight(const SceneLightRecord& record)
+{
+	PointLight light;
+	light.position = record.position;
+	light.ambient = record.ambient;
+	light.diffuse = record.diffuse;
+	light.specular = record.specular * record.specComp;
+	light.constant = record.constant;
+	light.linear = record.linear;
+	light.quadratic = record.quadratic;
+	light.radius = GetPointLightRadius(light);
+	return light;
+}
+
+/**
+ * @brief Scatters lanterns and candles around the shrine, with warm colors and short ranges.
+ * The same count always produces the same lights.
+ * @param[in] count Number of lights
+ * @param[in] areaRadius Radius of the disc the lights are scattered over
+ * @return Generated lights
+ */
+inline std::vector<PointLight> GenerateLanternLights(int count, float areaRadius)
+{
+	std::mt19937 random(1234u);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<PointLight> lights;
+	lights.reserve(std::max(count, 0));
+	for (int i = 0; i < count; i++)
+	{
+		float angle = unit(random) * 2.0f * 3.14159265f;
+		float distance = std::sqrt(unit(random)) * areaRadius;
+		glm::vec3 color = glm::mix(glm::vec3(1.0f, 0.45f, 0.1f), glm::vec3(1.0f, 0.8f, 0.45f), unit(random));
+
+		PointLight light;
+		light.position = glm::vec3(std::cos(angle) * distance, 0.5f + unit(random) * 3.0f, std::sin(angle) * distance);
+		light.ambient = color * 0.05f;
+		light.diffuse = color * (0.6f + unit(random) * 0.4f);
+		light.specular = color * 0.3f;
+		light.constant = 1.0f;
+		light.linear = 1.0f;
+		light.quadratic = 8.0f;
+		light.radius = GetPointLightRadius(light);
+		lights.push_back(light);
+	}
+	return lights;
+}
+
+/**
+ * @brief Creates a buffer texture backed by its own buffer.
+ * @param[in] format Internal format of the texels
+ * @param[out] buffer OpenGL handle to the created buffer
+ * @param[out] texture OpenGL handle to the created buffer texture
+ */
+inline void CreateClusterBufferTexture(GLenum format, GLuint& buffer, GLuint& texture)
+{
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+/**
+ * @brief Creates the light and cluster buffers. Call before the state cache is set up,
+ * or invalidate it afterwards.
+ * @param[in] nearPlane Distance of the near plane of the projection
+ * @param[in] farPlane Distance of the far plane of the projection
+ * @return Struct containing the created buffers
+ */
+inline ClusterGrid CreateClusterGrid(float nearPlane, float farPlane)
+{
+	ClusterGrid clusters;
+	clusters.nearPlane = nearPlane;
+	clusters.farPlane = farPlane;
+	clusters.boundsMin.resize(CLUSTER_COUNT);
+	clusters.boundsMax.resize(CLUSTER_COUNT);
+	clusters.grid.resize(CLUSTER_COUNT * 2);
+
+	CreateClusterBufferTexture(GL_RGBA32F, clusters.lightBuffer, clusters.lightTexture);
+	CreateClusterBufferTexture(GL_RG32UI, clusters.gridBuffer, clusters.gridTexture);
+	CreateClusterBufferTexture(GL_R32UI, clusters.indexBuffer, clusters.indexTexture);
+	return clusters;
+}
+
+/**
+ * @brief Gets the depth at which a slice of clusters starts.
+ * @param[in] clusters Cluster grid
+ * @param[in] slice Index of the slice, CLUSTER_COUNT_Z for the far plane
+ * @return Distance from the camera along the view direction
+ */
+inline float GetClusterSliceDepth(const ClusterGrid& clusters, int slice)
+{
+	return clusters.nearPlane * std::pow(clusters.farPlane / clusters.nearPlane, static_cast<float>(slice) / CLUSTER_COUNT_Z);
+}
+
+/**
+ * @brief Gets the slice of clusters a depth falls in, the inverse of GetClusterSliceDepth().
+ * @param[in] clusters Cluster grid
+ * @param[in] depth Distance from the camera along the view direction
+ * @return Index of the slice, clamped to the grid
+ */
+inline int GetClusterSlice(const ClusterGrid& clusters, float depth)
+{
+	float slice = std::log(std::max(depth, clusters.nearPlane) / clusters.nearPlane) / std::log(clusters.farPlane / clusters.nearPlane) * CLUSTER_COUNT_Z;
+	return std::min(std::max(static_cast<int>(slice), 0), CLUSTER_COUNT_Z - 1);
+}
+
+/**
+ * @brief Gets the tile a coordinate in normalized device coordinates falls in.
+ * @param[in] ndc Coordinate between -1 and 1
+ * @param[in] tileCount Number of tiles along the axis
+ * @return Index of the tile, clamped to the grid
+ */
+inline int GetClusterTile(float ndc, int tileCount)
+{
+	int tile = static_cast<int>(std::floor((ndc * 0.5f + 0.5f) * tileCount));
+	return std::min(std::max(tile, 0), tileCount - 1);
+}
+
+/**
+ * @brief Recomputes the view-space bounds of every cluster if the projection changed.
+ * @param[in,out] clusters Cluster grid
+ * @param[in] fov Vertical field of view, in degrees
+ * @param[in] aspect Aspect ratio of the viewport
+ */
+inline void UpdateClusterBounds(ClusterGrid& clusters, float fov, float aspect)
+{
+	if (fov == clusters.boundsFov && aspect == clusters.boundsAspect)
+	{
+		return;
+	}
+	clusters.boundsFov = fov;
+	clusters.boundsAspect = aspect;
+
+	float tanY = std::tan(glm::radians(fov) * 0.5f);
+	float tanX = tanY * aspect;
+	for (int z = 0; z < CLUSTER_COUNT_Z; z++)
+	{
+		float nearDepth = GetClusterSliceDepth(clusters, z);
+		float farDepth = GetClusterSliceDepth(clusters, z + 1);
+		for (int y = 0; y < CLUSTER_COUNT_Y; y++)
+		{
+			float y0 = -1.0f + 2.0f * y / CLUSTER_COUNT_Y;
+			float y1 = -1.0f + 2.0f * (y + 1) / CLUSTER_COUNT_Y;
+			for (int x = 0; x < CLUSTER_COUNT_X; x++)
+			{
+				float x0 = -1.0f + 2.0f * x / CLUSTER_COUNT_X;
+				float x1 = -1.0f + 2.0f * (x + 1) / CLUSTER_COUNT_X;
+
+				// The tile widens with depth, so its extremes are at either end of the slice
+				glm::vec3 boundsMin(
+					std::min(x0 * tanX * nearDepth, x0 * tanX * farDepth),
+					std::min(y0 * tanY * nearDepth, y0 * tanY * farDepth),
+					nearDepth);
+				glm::vec3 boundsMax(
+					std::max(x1 * tanX * nearDepth, x1 * tanX * farDepth),
+					std::max(y1 * tanY * nearDepth, y1 * tanY * farDepth),
+					farDepth);
+
+				int cluster = x + CLUSTER_COUNT_X * (y + CLUSTER_COUNT_Y * z);
+				clusters.boundsMin[cluster] = boundsMin;
+				clusters.boundsMax[cluster] = boundsMax;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Gets the factors the fragment shader uses to find the cluster of a fragment:
+ * x and y turn gl_FragCoord into a tile, z and w turn log(depth) into a slice.
+ * @param[in] clusters Cluster grid
+ * @param[in] width Width of the viewport in pixels
+ * @param[in] height Height of the viewport in pixels
+ * @return Factors of the lookup, stored in FrameBlock::clusterScale
+ */
+inline glm::vec4 GetClusterScale(const ClusterGrid& clusters, int width, int height)
+{
+	float logRange = std::log(clusters.farPlane / clusters.nearPlane);
+	return glm::vec4(
+		static_cast<float>(CLUSTER_COUNT_X) / std::max(width, 1),
+		static_cast<float>(CLUSTER_COUNT_Y) / std::max(height, 1),
+		CLUSTER_COUNT_Z / logRange,
+		-CLUSTER_COUNT_Z * std::log(clusters.nearPlane) / logRange);
+}
+
+/**
+ * @brief Packs a light into CLUSTER_LIGHT_TEXELS texels of lightData.
+ * @param[in] light Point light
+ * @param[out] texels Destination of the texels
+ */
+inline void PackPointLight(const PointLight& light, glm::vec4* texels)
+{
+	texels[0] = glm::vec4(light.position, light.radius);
+	texels[1] = glm::vec4(light.ambient, light.constant);
+	texels[2] = glm::vec4(light.diffuse, light.linear);
+	texels[3] = glm::vec4(light.specular, light.quadratic);
+}
+
+/**
+ * @brief Assigns every light to the clusters its sphere of influence touches and builds the
+ * staging data of the three buffers.
+ * @param[in,out] clusters Cluster grid
+ * @param[in] lights Point lights of the scene
+ * @param[in] view View matrix of the camera
+ * @param[in] fov Vertical field of view, in degrees
+ * @param[in] aspect Aspect ratio of the viewport
+ */
+inline void AssignLightsToClusters(ClusterGrid& clusters, const std::vector<PointLight>& lights, const glm::mat4& view, float fov, float aspect)
+{
+	UpdateClusterBounds(clusters, fov, aspect);
+
+	float tanY = std::tan(glm::radians(fov) * 0.5f);
+	float tanX = tanY * aspect;
+
+	clusters.lightCount = static_cast<uint32_t>(lights.size());
+	clusters.lightTexels.resize(lights.size() * CLUSTER_LIGHT_TEXELS);
+	clusters.lightClusters.clear();
+	std::fill(clusters.grid.begin(), clusters.grid.end(), 0u);
+
+	// First pass: find the clusters of every light and count the lights of every cluster
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		const PointLight& light = lights[i];
+		PackPointLight(light, &clusters.lightTexels[i * CLUSTER_LIGHT_TEXELS]);
+
+		glm::vec3 viewPosition = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		glm::vec3 center(viewPosition.x, viewPosition.y, -viewPosition.z);
+		float radius = light.radius;
+		if (center.z + radius < clusters.nearPlane || center.z - radius > clusters.farPlane)
+		{
+			continue;
+		}
+
+		// Conservative tile range: the sphere's box seen from the nearest and farthest depth it spans
+		float minDepth = std::max(center.z - radius, clusters.nearPlane);
+		float maxDepth = std::min(center.z + radius, clusters.farPlane);
+		float left = center.x - radius, right = center.x + radius;
+		float bottom = center.y - radius, top = center.y + radius;
+		int x0 = GetClusterTile(left / ((left < 0.0f ? minDepth : maxDepth) * tanX), CLUSTER_COUNT_X);
+		int x1 = GetClusterTile(right / ((right > 0.0f ? minDepth : maxDepth) * tanX), CLUSTER_COUNT_X);
+		int y0 = GetClusterTile(bottom / ((bottom < 0.0f ? minDepth : maxDepth) * tanY), CLUSTER_COUNT_Y);
+		int y1 = GetClusterTile(top / ((top > 0.0f ? minDepth : maxDepth) * tanY), CLUSTER_COUNT_Y);
+		int z0 = GetClusterSlice(clusters, minDepth);
+		int z1 = GetClusterSlice(clusters, maxDepth);
+
+		size_t countSlot = clusters.lightClusters.size();
+		clusters.lightClusters.push_back(0);
+		for (int z = z0; z <= z1; z++)
+		{
+			for (int y = y0; y <= y1; y++)
+			{
+				for (int x = x0; x <= x1; x++)
+				{
+					// Refine with the exact sphere against box test
+					int cluster = x + CLUSTER_COUNT_X * (y + CLUSTER_COUNT_Y * z);
+					glm::vec3 closest = glm::clamp(center, clusters.boundsMin[cluster], clusters.boundsMax[cluster]);
+					glm::vec3 offset = closest - center;
+					if (glm::dot(offset, offset) <= radius * radius)
+					{
+						clusters.lightClusters.push_back(static_cast<uint32_t>(cluster));
+						clusters.lightClusters[countSlot]++;
+						clusters.grid[cluster * 2 + 1]++;
+					}
+				}
+			}
+		}
+		clusters.lightClusters.push_back(static_cast<uint32_t>(i));
+	}
+
+	// Turn the counts into offsets
+	uint32_t offset = 0;
+	clusters.maxClusterLights = 0;
+	for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+	{
+		uint32_t count = clusters.grid[cluster * 2 + 1];
+		clusters.grid[cluster * 2] = offset;
+		clusters.grid[cluster * 2 + 1] = 0;
+		clusters.maxClusterLights = std::max(clusters.maxClusterLights, count);
+		offset += count;
+	}
+
+	// Second pass: write the light indices of every cluster
+	clusters.indices.resize(std::max(offset, 1u));
+	for (size_t read = 0; read < clusters.lightClusters.size();)
+	{
+		uint32_t count = clusters.lightClusters[read];
+		uint32_t light = clusters.lightClusters[read + 1 + count];
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t cluster = clusters.lightClusters[read + 1 + i];
+			clusters.indices[clusters.grid[cluster * 2] + clusters.grid[cluster * 2 + 1]++] = light;
+		}
+		read += count + 2;
+	}
+}
+
+/**
+ * @brief Uploads the staging data of the three buffers and binds their textures.
+ * Each buffer is respecified, so the driver does not wait for draws still reading the previous frame's data.
+ * @param[in,out] state State cache
+ * @param[in] clusters Cluster grid
+ */
+inline void UploadClusterGrid(GLStateCache& state, const ClusterGrid& clusters)
+{
+	// Buffer textures need a non-empty buffer even without lights
+	glm::vec4 emptyLight(0.0f);
+	const void* lightData = clusters.lightTexels.empty() ? &emptyLight : static_cast<const void*>(clusters.lightTexels.data());
+	GLsizeiptr lightSize = clusters.lightTexels.empty() ? sizeof(emptyLight) : clusters.lightTexels.size() * sizeof(glm::vec4);
+
+	BindBuffer(state, GL_TEXTURE_BUFFER, clusters.lightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, lightSize, lightData, GL_STREAM_DRAW);
+	BindBuffer(state, GL_TEXTURE_BUFFER, clusters.gridBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, clusters.grid.size() * sizeof(uint32_t), clusters.grid.data(), GL_STREAM_DRAW);
+	BindBuffer(state, GL_TEXTURE_BUFFER, clusters.indexBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, clusters.indices.size() * sizeof(uint32_t), clusters.indices.data(), GL_STREAM_DRAW);
+
+	BindTexture(state, LIGHT_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, clusters.lightTexture);
+	BindTexture(state, CLUSTER_GRID_TEXTURE_UNIT, GL_TEXTURE_BUFFER, clusters.gridTexture);
+	BindTexture(state, LIGHT_INDEX_TEXTURE_UNIT, GL_TEXTURE_BUFFER, clusters.indexTexture);
+}
+
+/**
+ * @brief Deletes the light and cluster buffers.
+ * @param[in,out] clusters Cluster grid to delete
+ */
+inline void DeleteClusterGrid(ClusterGrid& clusters)
+{
+	glDeleteTextures(1, &clusters.lightTexture);
+	glDeleteTextures(1, &clusters.gridTexture);
+	glDeleteTextures(1, &clusters.indexTexture);
+	glDeleteBuffers(1, &clusters.lightBuffer);
+	glDeleteBuffers(1, &clusters.gridBuffer);
+	glDeleteBuffers(1, &clusters.indexBuffer);
+	clusters = ClusterGrid();
+}
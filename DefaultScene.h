@@ -0,0 +1,224 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iterator>
+#include <vector>
+
+#include "Instancing.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "Vertex.h"
+
+// ---------------
+// Default shrine scene, written out as a scene file when none exists yet
+// ---------------
+
+/**
+ * Vertices of the default scene: a cube used by every torii gate part, followed by the
+ * back, side and floor panels. Every 4 vertices form one quad, laid out as a triangle strip.
+ */
+const Vertex DEFAULT_SCENE_VERTICES[] =
+{
+	// Position				Color			UV			Normal
+	//Front Facing Square
+	{ -3.0f, 1.0f, 2.0f,	255, 0, 0,	0.0f, 0.0f,	0.0f, 0.0f, 1.0f },
+	{ -3.0f, 3.0f, 2.0f,	0, 255, 0,	1.0f, 0.0f,	0.0f, 0.0f, 1.0f },
+	{ -5.0f, 1.0f, 2.0f,	0, 0, 255,	0.0f, 1.0f,	0.0f, 0.0f, 1.0f },
+	{ -5.0f, 3.0f, 2.0f,	0, 0, 255,	1.0f, 1.0f,	0.0f, 0.0f, 1.0f },
+	//Back Facing Square
+	{ -3.0f, 1.0f, 0.0f,	0, 0, 0,	0.0f, 0.0f,	0.0f, 0.0f, -1.0f },
+	{ -3.0f, 3.0f, 0.0f,	0, 0, 0,	1.0f, 0.0f,	0.0f, 0.0f, -1.0f },
+	{ -5.0f, 1.0f, 0.0f,	0, 0, 255,	0.0f, 1.0f,	0.0f, 0.0f, -1.0f },
+	{ -5.0f, 3.0f, 0.0f,	0, 0, 255,	1.0f, 1.0f,	0.0f, 0.0f, -1.0f },
+	//Right Facing Square
+	{ -3.0f, 3.0f, 0.0f,	255, 0, 0,	0.0f, 0.0f,	1.0f, 0.0f, 0.0f },
+	{ -3.0f, 1.0f, 0.0f,	0, 255, 0,	1.0f, 0.0f,	1.0f, 0.0f, 0.0f },
+	{ -3.0f, 3.0f, 2.0f,	255, 0, 0,	0.0f, 1.0f,	1.0f, 0.0f, 0.0f },
+	{ -3.0f, 1.0f, 2.0f,	0, 0, 0,	1.0f, 1.0f,	1.0f, 0.0f, 0.0f },
+	//Top Facing Square
+	{ -3.0f, 3.0f, 0.0f,	0, 0, 255,	0.0f, 0.0f,	0.0f, 1.0f, 0.0f },
+	{ -3.0f, 3.0f, 2.0f,	0, 0, 255,	1.0f, 0.0f,	0.0f, 1.0f, 0.0f },
+	{ -5.0f, 3.0f, 0.0f,	0, 255, 0,	0.0f, 1.0f,	0.0f, 1.0f, 0.0f },
+	{ -5.0f, 3.0f, 2.0f,	0, 255, 0,	1.0f, 1.0f,	0.0f, 1.0f, 0.0f },
+	//Left Facing Square
+	{ -5.0f, 1.0f, 2.0f,	0, 0, 255,	0.0f, 0.0f,	-1.0f, 0.0f, 0.0f },
+	{ -5.0f, 3.0f, 2.0f,	0, 0, 255,	1.0f, 0.0f,	-1.0f, 0.0f, 0.0f },
+	{ -5.0f, 1.0f, 0.0f,	0, 0, 255,	0.0f, 1.0f,	-1.0f, 0.0f, 0.0f },
+	{ -5.0f, 3.0f, 0.0f,	0, 0, 255,	1.0f, 1.0f,	-1.0f, 0.0f, 0.0f },
+	//Bottom Facing Square
+	{ -3.0f, 1.0f, 2.0f,	0, 0, 0,	0.0f, 0.0f,	0.0f, -1.0f, 0.0f },
+	{ -3.0f, 1.0f, 0.0f,	0, 0, 0,	1.0f, 0.0f,	0.0f, -1.0f, 0.0f },
+	{ -5.0f, 1.0f, 2.0f,	0, 0, 255,	0.0f, 1.0f,	0.0f, -1.0f, 0.0f },
+	{ -5.0f, 1.0f, 0.0f,	0, 0, 255,	1.0f, 1.0f,	0.0f, -1.0f, 0.0f },
+	//Back Panel
+	{ 10.0f, 1.0f, -5.0f,	0, 0, 0,	0.0f, 0.0f,	0.0f, 0.0f, 1.0f },
+	{ 10.0f, 15.0f, -5.0f,	0, 0, 0,	1.0f, 0.0f,	0.0f, 0.0f, 1.0f },
+	{ -11.0f, 1.0f, -5.0f,	0, 0, 255,	0.0f, 1.0f,	0.0f, 0.0f, 1.0f },
+	{ -11.0f, 15.0f, -5.0f,	0, 0, 255,	1.0f, 1.0f,	0.0f, 0.0f, 1.0f },
+	//Left Side Panel
+	{ -11.0f, 15.0f, -5.0f,	242, 172, 164,	0.0f, 0.0f,	1.0f, 0.0f, 0.0f },
+	{ -11.0f, 1.0f, -5.0f,	242, 172, 164,	1.0f, 0.0f,	1.0f, 0.0f, 0.0f },
+	{ -11.0f, 15.0f, 7.0f,	242, 172, 164,	0.0f, 1.0f,	1.0f, 0.0f, 0.0f },
+	{ -11.0f, 1.0f, 7.0f,	242, 172, 164,	1.0f, 1.0f,	1.0f, 0.0f, 0.0f },
+	//Right Side Panel
+	{ 10.0f, 15.0f, -5.0f,	242, 172, 164,	0.0f, 0.0f,	-1.0f, 0.0f, 0.0f },
+	{ 10.0f, 1.0f, -5.0f,	242, 172, 164,	1.0f, 0.0f,	-1.0f, 0.0f, 0.0f },
+	{ 10.0f, 15.0f, 7.0f,	242, 172, 164,	0.0f, 1.0f,	-1.0f, 0.0f, 0.0f },
+	{ 10.0f, 1.0f, 7.0f,	242, 172, 164,	1.0f, 1.0f,	-1.0f, 0.0f, 0.0f },
+	//Floor Panel
+	{ 10.0f, 1.0f, -5.0f,	0, 0, 255,	0.0f, 0.0f,	0.0f, 1.0f, 0.0f },
+	{ 10.0f, 1.0f, 7.0f,	0, 0, 255,	1.0f, 0.0f,	0.0f, 1.0f, 0.0f },
+	{ -11.0f, 1.0f, -5.0f,	0, 0, 255,	0.0f, 1.0f,	0.0f, 1.0f, 0.0f },
+	{ -11.0f, 1.0f, 7.0f,	0, 0, 255,	1.0f, 1.0f,	0.0f, 1.0f, 0.0f },
+};
+
+/**
+ * Textures of the default scene, in the order gate parts and panels refer to them
+ */
+enum DefaultSceneTexture : uint32_t
+{
+	TEXTURE_REDWOOD,
+	TEXTURE_TORII_BASE,
+	TEXTURE_BACK_PANEL,
+	TEXTURE_FLOOR,
+	TEXTURE_SIDE_PANEL
+};
+
+/**
+ * @brief Builds the parts of a torii gate of the default scene.
+ * @return The model matrix and index into the default scene textures of every gate part
+ */
+inline std::vector<ToriiGatePart> GetToriiGateParts()
+{
+	std::vector<ToriiGatePart> parts(TORII_GATE_PART_COUNT);
+
+	//Left Torii Base
+	parts[0].model = glm::mat4(1.0f);
+	parts[0].texIndex = TEXTURE_TORII_BASE;
+
+	//Left Torii Pillar
+	parts[1].model = glm::mat4(1.0f);
+	parts[1].model = glm::translate(parts[1].model, glm::vec3(-1.0f, -3.5f, 0.125f));
+	parts[1].model = glm::scale(parts[1].model, glm::vec3(0.75f, 6.0f, 0.75f));
+	parts[1].texIndex = TEXTURE_REDWOOD;
+
+	//Right Torii Base
+	parts[2].model = glm::mat4(1.0f);
+	parts[2].model = glm::translate(parts[2].model, glm::vec3(6.0f, 0.0f, 0.0f));
+	parts[2].texIndex = TEXTURE_TORII_BASE;
+
+	//Right Torii Pillar
+	parts[3].model = glm::mat4(1.0f);
+	parts[3].model = glm::translate(parts[3].model, glm::vec3(-1.0f, -3.5f, 0.125f));
+	parts[3].model = glm::scale(parts[3].model, glm::vec3(0.75f, 6.0f, 0.75f));
+	parts[3].model = glm::translate(parts[3].model, glm::vec3(8.0f, 0.0f, 0.0f));
+	parts[3].texIndex = TEXTURE_REDWOOD;
+
+	//Middle Horizontal Pillar
+	parts[4].model = glm::mat4(1.0f);
+	parts[4].model = glm::translate(parts[4].model, glm::vec3(11.0f, 12.5f, 0.135f));
+	parts[4].model = glm::rotate(parts[4].model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	parts[4].model = glm::scale(parts[4].model, glm::vec3(0.3f, 6.0f, 0.7f));
+	parts[4].texIndex = TEXTURE_REDWOOD;
+
+	//Middle Top Pillar
+	parts[5].model = glm::mat4(1.0f);
+	parts[5].model = glm::translate(parts[5].model, glm::vec3(11.0f, 15.999f, 0.135f));
+	parts[5].model = glm::rotate(parts[5].model, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	parts[5].model = glm::scale(parts[5].model, glm::vec3(0.3f, 6.0f, 0.7f));
+	parts[5].texIndex = TEXTURE_REDWOOD;
+	parts[5].flags = SCENE_OBJECT_KASAGI;
+
+	//Left Roof Wing
+	parts[6].model = glm::mat4(1.0f);
+	parts[6].model = glm::translate(parts[6].model, glm::vec3(-5.65f, 15.699f, 0.136f));
+	parts[6].model = glm::rotate(parts[6].model, glm::radians(75.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	parts[6].model = glm::scale(parts[6].model, glm::vec3(0.3f, 1.0f, 0.69f));
+	parts[6].texIndex = TEXTURE_REDWOOD;
+
+	//Right Roof Wing
+	parts[7].model = glm::mat4(1.0f);
+	parts[7].model = glm::translate(parts[7].model, glm::vec3(7.52f, 16.735f, 0.135f));
+	parts[7].model = glm::rotate(parts[7].model, glm::radians(105.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	parts[7].model = glm::scale(parts[7].model, glm::vec3(0.3f, 1.0f, 0.69f));
+	parts[7].texIndex = TEXTURE_REDWOOD;
+
+	return parts;
+}
+
+/**
+ * @brief Gets the global light of the default scene.
+ * @return Global light, orbited around the scene by the render loop
+ */
+inline SceneLightRecord GetDefaultGlobalLight()
+{
+	SceneLightRecord globalLight = {};
+	globalLight.type = SCENE_LIGHT_GLOBAL;
+	globalLight.position = glm::vec3(0.0f, 10.0f, 10.0f);
+	globalLight.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+	globalLight.diffuse = glm::vec3(0.9f, 0.9f, 0.9f);
+	globalLight.specular = glm::vec3(0.2f, 0.1f, 0.2f);
+	globalLight.specComp = glm::vec3(0.9f, 0.0f, 0.0f);
+	globalLight.constant = 1.0f;
+	return globalLight;
+}
+
+/**
+ * @brief Builds the default shrine scene: one torii gate in front of a back panel, two side panels and a floor.
+ * @return The default scene
+ */
+inline SceneBuilder BuildDefaultScene()
+{
+	SceneBuilder builder;
+	builder.vertices.assign(std::begin(DEFAULT_SCENE_VERTICES), std::end(DEFAULT_SCENE_VERTICES));
+
+	AddSceneTexture(builder, "toriigate_redwood.jpg");
+	AddSceneTexture(builder, "toriigate_base2.jpg");
+	AddSceneTexture(builder, "backpanel.jpg");
+	AddSceneTexture(builder, "floor.jpg");
+	AddSceneTexture(builder, "sidepanel.jpg");
+
+	// Index the quads of the vertex table as triangle lists, one range per object shape
+	MeshRange cubeRange = AppendQuadStripIndices(builder.indices, 0, 6);
+	MeshRange backPanelRange = AppendQuadStripIndices(builder.indices, 24, 1);
+	MeshRange leftPanelRange = AppendQuadStripIndices(builder.indices, 28, 1);
+	MeshRange rightPanelRange = AppendQuadStripIndices(builder.indices, 32, 1);
+	MeshRange floorPanelRange = AppendQuadStripIndices(builder.indices, 36, 1);
+
+	//Torii Gate Parts
+	for (const ToriiGatePart& part : GetToriiGateParts())
+	{
+		AddSceneObject(builder, part.model, cubeRange, part.texIndex, SCENE_OBJECT_GATE_PART | part.flags);
+	}
+
+	// The walls are matte, so they are drawn without the specular math. The side walls are
+	// far from the candle and only lit by the global light.
+	//Back Panel
+	AddSceneObject(builder, glm::mat4(1.0f), backPanelRange, TEXTURE_BACK_PANEL, SCENE_OBJECT_NO_SPECULAR);
+	//Left Panel
+	AddSceneObject(builder, glm::mat4(1.0f), leftPanelRange, TEXTURE_SIDE_PANEL, SCENE_OBJECT_NO_SPECULAR | SCENE_OBJECT_NO_POINT_LIGHTS);
+	//Right Panel
+	AddSceneObject(builder, glm::mat4(1.0f), rightPanelRange, TEXTURE_SIDE_PANEL, SCENE_OBJECT_NO_SPECULAR | SCENE_OBJECT_NO_POINT_LIGHTS);
+	//Floor Panel
+	AddSceneObject(builder, glm::mat4(1.0f), floorPanelRange, TEXTURE_FLOOR, 0);
+
+	// Global Light Specs
+	builder.lights.push_back(GetDefaultGlobalLight());
+
+	// Candle Spotlight *change to orange color*
+	SceneLightRecord candle = {};
+	candle.type = SCENE_LIGHT_POINT;
+	candle.position = glm::vec3(-1.0f, 0.0f, -3.5f);
+	candle.ambient = glm::vec3(1.0f, 0.65f, 0.0f);
+	candle.diffuse = glm::vec3(0.9f, 0.9f, 0.9f);
+	candle.specular = glm::vec3(0.2f, 0.1f, 0.2f);
+	candle.specComp = glm::vec3(0.9f, 0.0f, 0.0f);
+	candle.constant = 1.0f;
+	candle.linear = 0.09f;
+	candle.quadratic = 0.032f;
+	builder.lights.push_back(candle);
+
+	return builder;
+}
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "ClusteredLighting.h"
+#include "GLState.h"
+#include "Mesh.h"
+#include "Vertex.h"
+
+// ---------------
+// Deferred shading
+// ---------------
+//
+// The geometry pass writes every visible surface into a compact G-buffer instead of shading it:
+//   albedo  RGBA8          texture color
+//   normal  RG16           octahedral-encoded world normal
+//   depth   DEPTH24        reused as the position, rebuilt with the inverse view-projection
+// The lighting passes then read it back: a full-screen triangle applies the global light,
+// and every point light draws a sphere of its radius (see GetPointLightRadius()), blended
+// additively, so each light only costs the pixels it covers on screen.
+//
+// RG16_SNORM is not required to be color-renderable before OpenGL 4.4, so the normal is
+// stored in an unsigned format and remapped to [0, 1] by the shaders.
+
+// Texture units of the G-buffer, after the buffer textures of ClusteredLighting.h
+const GLuint GBUFFER_ALBEDO_TEXTURE_UNIT = 4;
+const GLuint GBUFFER_NORMAL_TEXTURE_UNIT = 5;
+const GLuint GBUFFER_DEPTH_TEXTURE_UNIT = 6;
+
+const int LIGHT_VOLUME_RINGS = 8;
+const int LIGHT_VOLUME_SEGMENTS = 12;
+
+/**
+ * Renderers selectable at startup
+ */
+enum RendererType
+{
+	RENDERER_FORWARD = 0,	// Clustered forward shading, see ClusteredLighting.h
+	RENDERER_DEFERRED
+};
+
+/**
+ * Struct containing the G-buffer framebuffer and its attachments
+ */
+struct GBuffer
+{
+	GLuint fbo = 0;
+	GLuint albedo = 0;
+	GLuint normal = 0;
+	GLuint depth = 0;
+	int width = 0;
+	int height = 0;
+};
+
+/**
+ * Struct containing everything the deferred renderer owns
+ */
+struct DeferredRenderer
+{
+	GBuffer gbuffer;
+
+	// Unit sphere drawn once per point light
+	Mesh lightVolume;
+	MeshRange lightVolumeRange;
+
+	// Vertex array object without any attribute, for the full-screen triangle
+	GLuint fullscreenVao = 0;
+
+	// Point lights, in the same layout as the lightData buffer texture of ClusteredLighting.h
+	GLuint lightBuffer = 0;
+	GLuint lightTexture = 0;
+	std::vector<glm::vec4> lightTexels;
+	GLsizei lightCount = 0;
+};
+
+/**
+ * @brief Parses the name of a renderer.
+ * @param[in] name "forward" or "deferred"
+ * @param[out] renderer Parsed renderer
+ * @return True if the name is known, false otherwise
+ */
+inline bool ParseRendererType(const std::string& name, RendererType& renderer)
+{
+	if (name == "forward")
+	{
+		renderer = RENDERER_FORWARD;
+	}
+	else if (name == "deferred")
+	{
+		renderer = RENDERER_DEFERRED;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Creates a texture used as a G-buffer attachment.
+ * @param[in] internalFormat Internal format of the texture
+ * @param[in] format Format of the (absent) pixel data
+ * @param[in] type Type of the (absent) pixel data
+ * @param[in] width Width of the texture
+ * @param[in] height Height of the texture
+ * @return OpenGL handle to the created texture
+ */
+inline GLuint CreateGBufferTexture(GLenum internalFormat, GLenum format, GLenum type, int width, int height)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+
+	// The lighting passes fetch exact texels, never filtered ones
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+/**
+ * @brief Creates the G-buffer. Leaves it bound as the draw framebuffer.
+ * @param[in] width Width of the G-buffer, the same as the viewport
+ * @param[in] height Height of the G-buffer, the same as the viewport
+ * @param[out] gbuffer Created G-buffer
+ * @return True if the framebuffer is complete, false otherwise
+ */
+inline bool CreateGBuffer(int width, int height, GBuffer& gbuffer)
+{
+	gbuffer.width = width;
+	gbuffer.height = height;
+	gbuffer.albedo = CreateGBufferTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+	gbuffer.normal = CreateGBufferTexture(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, width, height);
+	gbuffer.depth = CreateGBufferTexture(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, width, height);
+
+	glGenFramebuffers(1, &gbuffer.fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, gbuffer.fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gbuffer.albedo, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gbuffer.normal, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gbuffer.depth, 0);
+
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+/**
+ * @brief Deletes the G-buffer and its attachments.
+ * @param[in,out] gbuffer G-buffer to delete
+ */
+inline void DeleteGBuffer(GBuffer& gbuffer)
+{
+	glDeleteFramebuffers(1, &gbuffer.fbo);
+	glDeleteTextures(1, &gbuffer.albedo);
+	glDeleteTextures(1, &gbuffer.normal);
+	glDeleteTextures(1, &gbuffer.depth);
+	gbuffer = GBuffer();
+}
+
+/**
+ * @brief Builds a sphere enclosing the unit sphere, so a light volume never cuts into its light's radius.
+ * @param[out] vertices Vertices of the sphere, only their positions are used
+ * @param[out] indices Triangle list of the sphere
+ */
+inline void BuildLightVolumeSphere(std::vector<Vertex>& vertices, std::vector<GLushort>& indices)
+{
+	const float pi = 3.14159265f;
+
+	// The flat faces lie inside the sphere through their vertices, so push the vertices out
+	float scale = 1.0f / (std::cos(pi / LIGHT_VOLUME_SEGMENTS) * std::cos(pi / (2.0f * LIGHT_VOLUME_RINGS)));
+
+	for (int ring = 0; ring <= LIGHT_VOLUME_RINGS; ring++)
+	{
+		float theta = pi * ring / LIGHT_VOLUME_RINGS;
+		for (int segment = 0; segment <= LIGHT_VOLUME_SEGMENTS; segment++)
+		{
+			float phi = 2.0f * pi * segment / LIGHT_VOLUME_SEGMENTS;
+			Vertex vertex = {};
+			vertex.x = std::sin(theta) * std::cos(phi) * scale;
+			vertex.y = std::cos(theta) * scale;
+			vertex.z = std::sin(theta) * std::sin(phi) * scale;
+			vertices.push_back(vertex);
+		}
+	}
+
+	for (int ring = 0; ring < LIGHT_VOLUME_RINGS; ring++)
+	{
+		for (int segment = 0; segment < LIGHT_VOLUME_SEGMENTS; segment++)
+		{
+			GLushort v = static_cast<GLushort>(ring * (LIGHT_VOLUME_SEGMENTS + 1) + segment);
+			GLushort below = static_cast<GLushort>(v + LIGHT_VOLUME_SEGMENTS + 1);
+			indices.push_back(v);
+			indices.push_back(static_cast<GLushort>(v + 1));
+			indices.push_back(below);
+			indices.push_back(below);
+			indices.push_back(static_cast<GLushort>(v + 1));
+			indices.push_back(static_cast<GLushort>(below + 1));
+		}
+	}
+}
+
+/**
+ * @brief Creates the G-buffer, the light volume and the point light buffer.
+ * Changes bindings behind the state cache's back, so call it before the cache is set up.
+ * @param[in] width Width of the viewport
+ * @param[in] height Height of the viewport
+ * @param[out] renderer Created renderer
+ * @return True if the G-buffer is complete, false otherwise
+ */
+inline bool CreateDeferredRenderer(int width, int height, DeferredRenderer& renderer)
+{
+	std::vector<Vertex> vertices;
+	std::vector<GLushort> indices;
+	BuildLightVolumeSphere(vertices, indices);
+	renderer.lightVolume = CreateMesh(vertices.data(), vertices.size(), indices.data(), indices.size());
+	renderer.lightVolumeRange.firstIndex = 0;
+	renderer.lightVolumeRange.indexCount = static_cast<GLsizei>(indices.size());
+
+	glGenVertexArrays(1, &renderer.fullscreenVao);
+	CreateClusterBufferTexture(GL_RGBA32F, renderer.lightBuffer, renderer.lightTexture);
+
+	bool complete = CreateGBuffer(width, height, renderer.gbuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+/**
+ * @brief Recreates the G-buffer when the viewport changed size.
+ * @param[in,out] renderer Deferred renderer
+ * @param[in,out] state State cache, whose texture bindings the recreation changes
+ * @param[in] width Width of the viewport
+ * @param[in] height Height of the viewport
+ */
+inline void ResizeGBuffer(DeferredRenderer& renderer, GLStateCache& state, int width, int height)
+{
+	if (width == renderer.gbuffer.width && height == renderer.gbuffer.height)
+	{
+		return;
+	}
+
+	DeleteGBuffer(renderer.gbuffer);
+	CreateGBuffer(width, height, renderer.gbuffer);
+	InvalidateGLState(state);
+}
+
+/**
+ * @brief Packs the point lights and uploads them for the light volume pass.
+ * @param[in,out] state State cache
+ * @param[in,out] renderer Deferred renderer
+ * @param[in] lights Point lights of the scene
+ */
+inline void UploadDeferredLights(GLStateCache& state, DeferredRenderer& renderer, const std::vector<PointLight>& lights)
+{
+	renderer.lightCount = static_cast<GLsizei>(lights.size());
+	renderer.lightTexels.resize(std::max<size_t>(lights.size(), 1) * CLUSTER_LIGHT_TEXELS);
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		PackPointLight(lights[i], &renderer.lightTexels[i * CLUSTER_LIGHT_TEXELS]);
+	}
+
+	BindBuffer(state, GL_TEXTURE_BUFFER, renderer.lightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, renderer.lightTexels.size() * sizeof(glm::vec4), renderer.lightTexels.data(), GL_STREAM_DRAW);
+}
+
+/**
+ * @brief Makes the G-buffer the target of the draws that follow, so they fill it instead of the screen.
+ * @param[in] renderer Deferred renderer
+ */
+inline void BeginGeometryPass(const DeferredRenderer& renderer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, renderer.gbuffer.fbo);
+}
+
+/**
+ * @brief Shades the G-buffer into the output framebuffer: the global light over the whole
+ * screen, then every point light over the pixels its volume covers.
+ * @param[in] renderer Deferred renderer
+ * @param[in,out] state State cache
+ * @param[in] outputFramebuffer Framebuffer receiving the shaded image, 0 for the window
+ * @param[in] globalProgram Program of the global light pass
+ * @param[in] pointProgram Program of the light volume pass
+ */
+inline void RunLightingPass(const DeferredRenderer& renderer, GLStateCache& state, GLuint outputFramebuffer, GLuint globalProgram, GLuint pointProgram)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+	SetCapability(state, GL_DEPTH_TEST, false);
+
+	BindTexture(state, GBUFFER_ALBEDO_TEXTURE_UNIT, GL_TEXTURE_2D, renderer.gbuffer.albedo);
+	BindTexture(state, GBUFFER_NORMAL_TEXTURE_UNIT, GL_TEXTURE_2D, renderer.gbuffer.normal);
+	BindTexture(state, GBUFFER_DEPTH_TEXTURE_UNIT, GL_TEXTURE_2D, renderer.gbuffer.depth);
+	BindTexture(state, LIGHT_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, renderer.lightTexture);
+
+	// Every pixel gets the global light, which also overwrites the previous frame
+	UseProgram(state, globalProgram);
+	BindVertexArray(state, renderer.fullscreenVao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// Point lights add up. Only the back faces of the volumes are drawn, so a volume still
+	// covers its pixels when the camera is inside it.
+	if (renderer.lightCount > 0)
+	{
+		SetCapability(state, GL_BLEND, true);
+		SetCapability(state, GL_CULL_FACE, true);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glCullFace(GL_FRONT);
+
+		UseProgram(state, pointProgram);
+		BindVertexArray(state, renderer.lightVolume.vao);
+		DrawMeshRangeInstanced(renderer.lightVolume, renderer.lightVolumeRange, renderer.lightCount);
+
+		glCullFace(GL_BACK);
+		SetCapability(state, GL_CULL_FACE, false);
+		SetCapability(state, GL_BLEND, false);
+	}
+
+	SetCapability(state, GL_DEPTH_TEST, true);
+}
+
+/**
+ * @brief Deletes everything the deferred renderer owns.
+ * @param[in,out] renderer Deferred renderer to delete
+ */
+inline void DeleteDeferredRenderer(DeferredRenderer& renderer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	DeleteGBuffer(renderer.gbuffer);
+	DeleteMesh(renderer.lightVolume);
+	glDeleteVertexArrays(1, &renderer.fullscreenVao);
+	glDeleteTextures(1, &renderer.lightTexture);
+	glDeleteBuffers(1, &renderer.lightBuffer);
+	renderer = DeferredRenderer();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <vector>
+
+#include "ClusteredLighting.h"
+#include "DefaultScene.h"
+#include "Instancing.h"
+#include "Mesh.h"
+#include "Scene.h"
+
+// ---------------
+// Procedural torii forest, a stress scene for scaling benchmarks
+// ---------------
+//
+// Gates built from the parts of the default gate are placed on the same grid as the instanced
+// path, on one floor stretched under all of them, with lanterns scattered among them. Every
+// gate uses one of several texture variants, each its own layer of the material array, so
+// the texture count can be scaled on its own. The same parameters always produce the same scene.
+
+const float FOREST_SPACING_X = 16.0f;
+const float FOREST_SPACING_Z = 12.0f;
+const int FOREST_MAX_TEXTURE_VARIANTS = 127;	// Two layers each plus the floor, within the 256 layers GL 3.3 guarantees
+
+/**
+ * @brief Builds a forest of torii gates.
+ * @param[in] gateCount Number of gates
+ * @param[in] lightCount Number of lanterns scattered over the forest
+ * @param[in] textureVariants Number of texture variants the gates cycle through
+ * @return The forest scene
+ */
+inline SceneBuilder BuildForestScene(int gateCount, int lightCount, int textureVariants)
+{
+	SceneBuilder builder;
+	builder.vertices.assign(std::begin(DEFAULT_SCENE_VERTICES), std::end(DEFAULT_SCENE_VERTICES));
+	MeshRange cubeRange = AppendQuadStripIndices(builder.indices, 0, 6);
+	MeshRange floorPanelRange = AppendQuadStripIndices(builder.indices, 36, 1);
+
+	// Every variant repeats the gate textures, so it costs as much as a distinct image would
+	textureVariants = std::min(std::max(textureVariants, 1), FOREST_MAX_TEXTURE_VARIANTS);
+	uint32_t floorTexture = AddSceneTexture(builder, "floor.jpg");
+	for (int variant = 0; variant < textureVariants; variant++)
+	{
+		AddSceneTexture(builder, "toriigate_redwood.jpg");
+		AddSceneTexture(builder, "toriigate_base2.jpg");
+	}
+
+	// Gates, with the parts of each gate next to each other
+	std::vector<ToriiGatePart> parts = GetToriiGateParts();
+	std::vector<glm::mat4> gates = GetGateGridTransforms(gateCount, FOREST_SPACING_X, FOREST_SPACING_Z);
+	glm::vec3 forestMin(0.0f), forestMax(0.0f);
+	for (size_t gate = 0; gate < gates.size(); gate++)
+	{
+		uint32_t firstTexture = 1 + static_cast<uint32_t>(gate % textureVariants) * 2;
+		for (const ToriiGatePart& part : parts)
+		{
+			AddSceneObject(builder, gates[gate] * part.model, cubeRange, firstTexture + part.texIndex, SCENE_OBJECT_GATE_PART | part.flags);
+		}
+
+		glm::vec3 origin = glm::vec3(gates[gate][3]);
+		forestMin = glm::min(forestMin, origin);
+		forestMax = glm::max(forestMax, origin);
+	}
+
+	// The floor panel of the default scene, stretched from its extent around one gate to the whole grid.
+	// The lanterns light it, but it is matte, so it is drawn without the specular math.
+	const glm::vec3 panelMin(-11.0f, 1.0f, -5.0f), panelMax(10.0f, 1.0f, 7.0f);
+	glm::vec3 floorMin = forestMin + panelMin, floorMax = forestMax + panelMax;
+	glm::vec3 panelCenter = (panelMin + panelMax) * 0.5f, floorCenter = (floorMin + floorMax) * 0.5f;
+	glm::mat4 floor = glm::translate(glm::mat4(1.0f), floorCenter);
+	floor = glm::scale(floor, glm::vec3((floorMax.x - floorMin.x) / (panelMax.x - panelMin.x), 1.0f, (floorMax.z - floorMin.z) / (panelMax.z - panelMin.z)));
+	floor = glm::translate(floor, -panelCenter);
+	AddSceneObject(builder, floor, floorPanelRange, floorTexture, SCENE_OBJECT_NO_SPECULAR);
+
+	builder.lights.push_back(GetDefaultGlobalLight());
+
+	// Lanterns over a disc covering the grid
+	glm::vec3 forestCenter = (forestMin + forestMax) * 0.5f;
+	float forestRadius = glm::length(glm::vec2(floorMax.x - floorMin.x, floorMax.z - floorMin.z)) * 0.5f;
+	for (const PointLight& lantern : GenerateLanternLights(lightCount, forestRadius))
+	{
+		SceneLightRecord light = {};
+		light.type = SCENE_LIGHT_POINT;
+		light.position = lantern.position + glm::vec3(forestCenter.x, 0.0f, forestCenter.z);
+		light.ambient = lantern.ambient;
+		light.diffuse = lantern.diffuse;
+		light.specular = lantern.specular;
+		light.specComp = glm::vec3(1.0f);
+		light.constant = lantern.constant;
+		light.linear = lantern.linear;
+		light.quadratic = lantern.quadratic;
+		builder.lights.push_back(light);
+	}
+
+	return builder;
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "Mesh.h"
+#include "Vertex.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLING_SSE 1
+#include <emmintrin.h>
+#endif
+
+// ---------------
+// Frustum culling
+// ---------------
+//
+// Every object has an axis-aligned bounding box, computed once from its vertices in model
+// space and moved to world space by the scene graph whenever the object moves. The world
+// boxes are organized in a bounding volume hierarchy, which is built once and refit when
+// boxes change. Each frame the hierarchy is walked against the six planes of the view
+// frustum: subtrees entirely outside are dropped, subtrees entirely inside are accepted
+// without testing their objects, and only the rest goes further down. A box is tested
+// against four planes at once with SSE.
+
+const int BVH_LEAF_SIZE = 4;		// Most objects in one leaf
+const int FRUSTUM_PLANE_SLOTS = 8;	// Six planes, padded to two SSE registers
+
+/**
+ * Struct containing an axis-aligned bounding box
+ */
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+};
+
+/**
+ * Result of testing a box against the frustum
+ */
+enum CullResult
+{
+	CULL_OUTSIDE = 0,
+	CULL_INTERSECTS,
+	CULL_INSIDE
+};
+
+/**
+ * Struct containing the planes of a view frustum, structure-of-arrays.
+ * A point p is inside a plane if x * p.x + y * p.y + z * p.z + d >= 0.
+ */
+struct Frustum
+{
+	alignas(16) float x[FRUSTUM_PLANE_SLOTS];
+	alignas(16) float y[FRUSTUM_PLANE_SLOTS];
+	alignas(16) float z[FRUSTUM_PLANE_SLOTS];
+	alignas(16) float d[FRUSTUM_PLANE_SLOTS];
+};
+
+/**
+ * Struct containing one node of a bounding volume hierarchy. Nodes are stored depth first,
+ * so the left child of an internal node directly follows it.
+ */
+struct BvhNode
+{
+	Bounds bounds;
+	int first = 0;		// First of the node's objects in Bvh::objects, all objects of a subtree are contiguous
+	int count = 0;		// Number of objects in the subtree
+	int right = 0;		// Index of the right child, 0 for a leaf
+};
+
+/**
+ * Struct containing a bounding volume hierarchy over the objects of a scene
+ */
+struct Bvh
+{
+	std::vector<BvhNode> nodes;
+	std::vector<int> objects;		// Object indices, ordered so every node covers a range
+};
+
+/**
+ * Struct containing the counters of the last culling pass
+ */
+struct CullingStats
+{
+	int objects = 0;		// Objects in the hierarchy
+	int visible = 0;
+	int culled = 0;
+	int boundsTests = 0;	// Boxes tested against the frustum, nodes and objects
+};
+
+/**
+ * @brief Computes the bounds of the vertices referenced by a range of indices.
+ * @param[in] vertices Vertex data
+ * @param[in] indices Index data
+ * @param[in] range Range of indices
+ * @return Bounds of the range in model space
+ */
+inline Bounds GetRangeBounds(const Vertex* vertices, const GLushort* indices, const MeshRange& range)
+{
+	Bounds bounds;
+	for (GLsizei i = 0; i < range.indexCount; i++)
+	{
+		const Vertex& vertex = vertices[indices[range.firstIndex + i]];
+		glm::vec3 position(vertex.x, vertex.y, vertex.z);
+		bounds.min = i == 0 ? position : glm::min(bounds.min, position);
+		bounds.max = i == 0 ? position : glm::max(bounds.max, position);
+	}
+	return bounds;
+}
+
+/**
+ * @brief Gets the smallest box holding two boxes.
+ * @param[in] a First box
+ * @param[in] b Second box
+ * @return Union of the boxes
+ */
+inline Bounds MergeBounds(const Bounds& a, const Bounds& b)
+{
+	Bounds merged;
+	merged.min = glm::min(a.min, b.min);
+	merged.max = glm::max(a.max, b.max);
+	return merged;
+}
+
+/**
+ * @brief Transforms a box and gets the axis-aligned box holding the result.
+ * @param[in] bounds Box to transform
+ * @param[in] transform Affine transform
+ * @return Transformed box
+ */
+inline Bounds TransformBounds(const Bounds& bounds, const glm::mat4& transform)
+{
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+	// Each axis of the new box spans the absolute projections of the old extents
+	glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+	glm::vec3 newExtent;
+	for (int row = 0; row < 3; row++)
+	{
+		newExtent[row] = std::fabs(transform[0][row]) * extent.x + std::fabs(transform[1][row]) * extent.y + std::fabs(transform[2][row]) * extent.z;
+	}
+
+	Bounds transformed;
+	transformed.min = newCenter - newExtent;
+	transformed.max = newCenter + newExtent;
+	return transformed;
+}
+
+/**
+ * @brief Extracts the planes of the frustum of a view-projection matrix.
+ * @param[in] viewProj Combined projection and view matrix
+ * @return Frustum planes, pointing inwards
+ */
+inline Frustum ExtractFrustum(const glm::mat4& viewProj)
+{
+	Frustum frustum;
+
+	// Each plane is the last row of the matrix plus or minus one of the others
+	for (int plane = 0; plane < 6; plane++)
+	{
+		int row = plane / 2;
+		float sign = (plane % 2 == 0) ? 1.0f : -1.0f;
+		frustum.x[plane] = viewProj[0][3] + sign * viewProj[0][row];
+		frustum.y[plane] = viewProj[1][3] + sign * viewProj[1][row];
+		frustum.z[plane] = viewProj[2][3] + sign * viewProj[2][row];
+		frustum.d[plane] = viewProj[3][3] + sign * viewProj[3][row];
+	}
+
+	// The padding planes accept everything
+	for (int plane = 6; plane < FRUSTUM_PLANE_SLOTS; plane++)
+	{
+		frustum.x[plane] = 0.0f;
+		frustum.y[plane] = 0.0f;
+		frustum.z[plane] = 0.0f;
+		frustum.d[plane] = 1.0f;
+	}
+	return frustum;
+}
+
+/**
+ * @brief Tests a box against the frustum.
+ * @param[in] frustum Frustum planes
+ * @param[in] bounds Box to test
+ * @return Whether the box is outside, partly inside or entirely inside the frustum
+ */
+inline CullResult TestBoundsFrustum(const Frustum& frustum, const Bounds& bounds)
+{
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+#ifdef FRUSTUM_CULLING_SSE
+	// Per plane, the distance of the center and the largest distance of a corner from it
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+	int outside = 0, intersecting = 0;
+	for (int plane = 0; plane < FRUSTUM_PLANE_SLOTS; plane += 4)
+	{
+		__m128 px = _mm_load_ps(frustum.x + plane);
+		__m128 py = _mm_load_ps(frustum.y + plane);
+		__m128 pz = _mm_load_ps(frustum.z + plane);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(frustum.d + plane)));
+		__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		intersecting |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+	}
+#else
+	bool outside = false, intersecting = false;
+	for (int plane = 0; plane < FRUSTUM_PLANE_SLOTS; plane++)
+	{
+		float distance = frustum.x[plane] * center.x + frustum.y[plane] * center.y + frustum.z[plane] * center.z + frustum.d[plane];
+		float radius = std::fabs(frustum.x[plane]) * extent.x + std::fabs(frustum.y[plane]) * extent.y + std::fabs(frustum.z[plane]) * extent.z;
+		outside = outside || distance + radius < 0.0f;
+		intersecting = intersecting || distance - radius < 0.0f;
+	}
+#endif
+
+	if (outside)
+	{
+		return CULL_OUTSIDE;
+	}
+	return intersecting ? CULL_INTERSECTS : CULL_INSIDE;
+}
+
+/**
+ * @brief Builds the subtree over a range of Bvh::objects, splitting at the median along the longest axis.
+ * @param[in,out] bvh Hierarchy being built
+ * @param[in] bounds World bounds of every object
+ * @param[in] first First object of the range
+ * @param[in] count Number of objects in the range
+ * @return Index of the subtree's root node
+ */
+inline int BuildBvhNode(Bvh& bvh, const std::vector<Bounds>& bounds, int first, int count)
+{
+	int index = static_cast<int>(bvh.nodes.size());
+	bvh.nodes.emplace_back();
+
+	Bounds nodeBounds = bounds[bvh.objects[first]];
+	for (int i = 1; i < count; i++)
+	{
+		nodeBounds = MergeBounds(nodeBounds, bounds[bvh.objects[first + i]]);
+	}
+
+	int right = 0;
+	if (count > BVH_LEAF_SIZE)
+	{
+		glm::vec3 size = nodeBounds.max - nodeBounds.min;
+		int axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+		int half = count / 2;
+		std::nth_element(bvh.objects.begin() + first, bvh.objects.begin() + first + half, bvh.objects.begin() + first + count,
+			[&bounds, axis](int a, int b)
+			{
+				return bounds[a].min[axis] + bounds[a].max[axis] < bounds[b].min[axis] + bounds[b].max[axis];
+			});
+
+		BuildBvhNode(bvh, bounds, first, half);
+		right = BuildBvhNode(bvh, bounds, first + half, count - half);
+	}
+
+	// The vector may have grown, so index again
+	BvhNode& node = bvh.nodes[index];
+	node.bounds = nodeBounds;
+	node.first = first;
+	node.count = count;
+	node.right = right;
+	return index;
+}
+
+/**
+ * @brief Builds a hierarchy over a set of objects.
+ * @param[out] bvh Hierarchy to build
+ * @param[in] bounds World bounds of every object, indexed by object
+ */
+inline void BuildBvh(Bvh& bvh, const std::vector<Bounds>& bounds)
+{
+	bvh.nodes.clear();
+	bvh.objects.resize(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		bvh.objects[i] = static_cast<int>(i);
+	}
+	if (!bounds.empty())
+	{
+		BuildBvhNode(bvh, bounds, 0, static_cast<int>(bounds.size()));
+	}
+}
+
+/**
+ * @brief Updates the boxes of every node after objects moved, keeping the structure.
+ * Cheaper than a rebuild, though the tree gets looser the further objects move.
+ * @param[in,out] bvh Hierarchy to refit
+ * @param[in] bounds World bounds of every object, indexed by object
+ */
+inline void RefitBvh(Bvh& bvh, const std::vector<Bounds>& bounds)
+{
+	// Children are stored after their parent, so going backwards visits them first
+	for (size_t i = bvh.nodes.size(); i-- > 0;)
+	{
+		BvhNode& node = bvh.nodes[i];
+		if (node.right == 0)
+		{
+			node.bounds = bounds[bvh.objects[node.first]];
+			for (int j = 1; j < node.count; j++)
+			{
+				node.bounds = MergeBounds(node.bounds, bounds[bvh.objects[node.first + j]]);
+			}
+		}
+		else
+		{
+			node.bounds = MergeBounds(bvh.nodes[i + 1].bounds, bvh.nodes[node.right].bounds);
+		}
+	}
+}
+
+/**
+ * @brief Collects the objects whose bounds intersect the frustum.
+ * @param[in] bvh Hierarchy over the objects
+ * @param[in] bounds World bounds of every object, indexed by object
+ * @param[in] frustum Frustum planes
+ * @param[out] visible Indices of the visible objects, in no particular order
+ * @param[out] stats Counters of the pass
+ */
+inline void CullBvh(const Bvh& bvh, const std::vector<Bounds>& bounds, const Frustum& frustum, std::vector<int>& visible, CullingStats& stats)
+{
+	visible.clear();
+	stats = CullingStats();
+	stats.objects = static_cast<int>(bvh.objects.size());
+	if (bvh.nodes.empty())
+	{
+		return;
+	}
+
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const BvhNode& node = bvh.nodes[stack[--stackSize]];
+		stats.boundsTests++;
+		CullResult result = TestBoundsFrustum(frustum, node.bounds);
+		if (result == CULL_OUTSIDE)
+		{
+			continue;
+		}
+
+		if (result == CULL_INSIDE)
+		{
+			visible.insert(visible.end(), bvh.objects.begin() + node.first, bvh.objects.begin() + node.first + node.count);
+		}
+		else if (node.right != 0)
+		{
+			stack[stackSize++] = node.right;
+			stack[stackSize++] = static_cast<int>(&node - bvh.nodes.data()) + 1;
+		}
+		else
+		{
+			for (int i = 0; i < node.count; i++)
+			{
+				int object = bvh.objects[node.first + i];
+				stats.boundsTests++;
+				if (TestBoundsFrustum(frustum, bounds[object]) != CULL_OUTSIDE)
+				{
+					visible.push_back(object);
+				}
+			}
+		}
+	}
+
+	stats.visible = static_cast<int>(visible.size());
+	stats.culled = stats.objects - stats.visible;
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// ---------------
+// OpenGL state cache
+// ---------------
+//
+// Thin wrappers over the state-changing GL calls used by the render loop. Each one
+// remembers what is currently bound and skips the call when nothing would change,
+// counting both the issued and the skipped calls.
+// Code that changes the tracked state behind the cache's back has to call
+// InvalidateGLState() afterwards.
+
+const int STATE_CACHE_TEXTURE_UNITS = 16;
+const int STATE_CACHE_UNIFORM_BINDINGS = 16;
+
+/**
+ * Handle value meaning "not known", so the next call is always issued
+ */
+const GLuint STATE_CACHE_UNKNOWN = 0xFFFFFFFFu;
+
+/**
+ * Texture targets tracked per texture unit
+ */
+enum StateCacheTextureTarget
+{
+	STATE_TEXTURE_2D = 0,
+	STATE_TEXTURE_2D_ARRAY,
+	STATE_TEXTURE_BUFFER,
+	STATE_TEXTURE_TARGET_COUNT
+};
+
+/**
+ * Buffer targets tracked by the cache. GL_ELEMENT_ARRAY_BUFFER is part of the VAO, so it is not tracked.
+ */
+enum StateCacheBufferTarget
+{
+	STATE_BUFFER_ARRAY = 0,
+	STATE_BUFFER_UNIFORM,
+	STATE_BUFFER_PIXEL_UNPACK,
+	STATE_BUFFER_TEXTURE,
+	STATE_BUFFER_TARGET_COUNT
+};
+
+/**
+ * Capabilities tracked by the cache, as bits of GLStateCache::enabled
+ */
+enum StateCacheCapability : uint32_t
+{
+	STATE_CAP_DEPTH_TEST = 1u << 0,
+	STATE_CAP_CULL_FACE = 1u << 1,
+	STATE_CAP_BLEND = 1u << 2,
+	STATE_CAP_SCISSOR_TEST = 1u << 3,
+	STATE_CAP_POLYGON_OFFSET_FILL = 1u << 4
+};
+
+/**
+ * Struct containing the number of state calls issued to and skipped before the driver
+ */
+struct GLStateCounters
+{
+	uint32_t issued = 0;
+	uint32_t skipped = 0;
+};
+
+/**
+ * Struct containing a uniform buffer range attached to an indexed binding point
+ */
+struct UniformBufferBinding
+{
+	GLuint buffer = 0;
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+};
+
+/**
+ * Struct containing the OpenGL state the render loop last set. A fresh context has everything
+ * unbound and every capability disabled, which is what the defaults describe.
+ */
+struct GLStateCache
+{
+	GLuint program = 0;
+	GLuint vao = 0;
+	GLenum activeUnit = 0;
+	GLuint textures[STATE_CACHE_TEXTURE_UNITS][STATE_TEXTURE_TARGET_COUNT] = {};
+	GLuint buffers[STATE_BUFFER_TARGET_COUNT] = {};
+	UniformBufferBinding uniformBindings[STATE_CACHE_UNIFORM_BINDINGS] = {};
+
+	// Bits of StateCacheCapability. Capabilities in unknownCaps are issued on their next change.
+	uint32_t enabled = 0;
+	uint32_t unknownCaps = 0;
+
+	GLStateCounters frame;		// Reset by BeginStateFrame()
+	GLStateCounters lastFrame;	// Counters of the previous frame
+};
+
+/**
+ * @brief Gets the tracked slot of a texture target.
+ * @param[in] target OpenGL texture target
+ * @return Slot of the target, or STATE_TEXTURE_TARGET_COUNT if it is not tracked
+ */
+inline int GetStateTextureTarget(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return STATE_TEXTURE_2D;
+	case GL_TEXTURE_2D_ARRAY: return STATE_TEXTURE_2D_ARRAY;
+	case GL_TEXTURE_BUFFER: return STATE_TEXTURE_BUFFER;
+	default: return STATE_TEXTURE_TARGET_COUNT;
+	}
+}
+
+/**
+ * @brief Gets the tracked slot of a buffer target.
+ * @param[in] target OpenGL buffer target
+ * @return Slot of the target, or STATE_BUFFER_TARGET_COUNT if it is not tracked
+ */
+inline int GetStateBufferTarget(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return STATE_BUFFER_ARRAY;
+	case GL_UNIFORM_BUFFER: return STATE_BUFFER_UNIFORM;
+	case GL_PIXEL_UNPACK_BUFFER: return STATE_BUFFER_PIXEL_UNPACK;
+	case GL_TEXTURE_BUFFER: return STATE_BUFFER_TEXTURE;
+	default: return STATE_BUFFER_TARGET_COUNT;
+	}
+}
+
+/**
+ * @brief Gets the tracked bit of a capability.
+ * @param[in] capability OpenGL capability, as passed to glEnable()
+ * @return Bit of the capability, or 0 if it is not tracked
+ */
+inline uint32_t GetStateCapabilityBit(GLenum capability)
+{
+	switch (capability)
+	{
+	case GL_DEPTH_TEST: return STATE_CAP_DEPTH_TEST;
+	case GL_CULL_FACE: return STATE_CAP_CULL_FACE;
+	case GL_BLEND: return STATE_CAP_BLEND;
+	case GL_SCISSOR_TEST: return STATE_CAP_SCISSOR_TEST;
+	case GL_POLYGON_OFFSET_FILL: return STATE_CAP_POLYGON_OFFSET_FILL;
+	default: return 0;
+	}
+}
+
+/**
+ * @brief Counts a state call as issued or skipped.
+ * @param[in,out] state State cache owning the counters
+ * @param[in] issued Whether the call reached the driver
+ * @return The value of issued, so callers can branch on it
+ */
+inline bool CountStateCall(GLStateCache& state, bool issued)
+{
+	if (issued)
+	{
+		state.frame.issued++;
+	}
+	else
+	{
+		state.frame.skipped++;
+	}
+	return issued;
+}
+
+/**
+ * @brief Forgets everything the cache knows, so the next call of each kind reaches the driver.
+ * @param[in,out] state State cache to invalidate
+ */
+inline void InvalidateGLState(GLStateCache& state)
+{
+	state.program = STATE_CACHE_UNKNOWN;
+	state.vao = STATE_CACHE_UNKNOWN;
+	state.activeUnit = STATE_CACHE_UNKNOWN;
+	for (auto& unit : state.textures)
+	{
+		for (GLuint& texture : unit)
+		{
+			texture = STATE_CACHE_UNKNOWN;
+		}
+	}
+	for (GLuint& buffer : state.buffers)
+	{
+		buffer = STATE_CACHE_UNKNOWN;
+	}
+	for (UniformBufferBinding& binding : state.uniformBindings)
+	{
+		binding.buffer = STATE_CACHE_UNKNOWN;
+	}
+	state.unknownCaps = ~0u;
+}
+
+/**
+ * @brief Starts counting the state calls of a new frame.
+ * @param[in,out] state State cache owning the counters
+ */
+inline void BeginStateFrame(GLStateCache& state)
+{
+	state.lastFrame = state.frame;
+	state.frame = GLStateCounters();
+}
+
+/**
+ * @brief glUseProgram(), skipped if the program is already in use.
+ * @param[in,out] state State cache
+ * @param[in] program OpenGL handle to the shader program
+ */
+inline void UseProgram(GLStateCache& state, GLuint program)
+{
+	if (CountStateCall(state, state.program != program))
+	{
+		glUseProgram(program);
+		state.program = program;
+	}
+}
+
+/**
+ * @brief glBindVertexArray(), skipped if the vertex array object is already bound.
+ * @param[in,out] state State cache
+ * @param[in] vao OpenGL handle to the vertex array object
+ */
+inline void BindVertexArray(GLStateCache& state, GLuint vao)
+{
+	if (CountStateCall(state, state.vao != vao))
+	{
+		glBindVertexArray(vao);
+		state.vao = vao;
+	}
+}
+
+/**
+ * @brief Binds a texture to a texture unit, skipping glActiveTexture() and glBindTexture() when they would not change anything.
+ * @param[in,out] state State cache
+ * @param[in] unit Index of the texture unit, not GL_TEXTURE0 + unit
+ * @param[in] target OpenGL texture target
+ * @param[in] texture OpenGL handle to the texture
+ */
+inline void BindTexture(GLStateCache& state, GLuint unit, GLenum target, GLuint texture)
+{
+	int slot = GetStateTextureTarget(target);
+	bool tracked = unit < static_cast<GLuint>(STATE_CACHE_TEXTURE_UNITS) && slot != STATE_TEXTURE_TARGET_COUNT;
+	if (tracked && state.textures[unit][slot] == texture)
+	{
+		CountStateCall(state, false);
+		return;
+	}
+
+	if (CountStateCall(state, state.activeUnit != unit))
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		state.activeUnit = unit;
+	}
+
+	CountStateCall(state, true);
+	glBindTexture(target, texture);
+	if (tracked)
+	{
+		state.textures[unit][slot] = texture;
+	}
+}
+
+/**
+ * @brief glBindBuffer(), skipped if the buffer is already bound to the target.
+ * @param[in,out] state State cache
+ * @param[in] target OpenGL buffer target
+ * @param[in] buffer OpenGL handle to the buffer
+ */
+inline void BindBuffer(GLStateCache& state, GLenum target, GLuint buffer)
+{
+	int slot = GetStateBufferTarget(target);
+	if (slot == STATE_BUFFER_TARGET_COUNT)
+	{
+		CountStateCall(state, true);
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (CountStateCall(state, state.buffers[slot] != buffer))
+	{
+		glBindBuffer(target, buffer);
+		state.buffers[slot] = buffer;
+	}
+}
+
+/**
+ * @brief glBindBufferRange() on GL_UNIFORM_BUFFER, skipped if the same range is already attached to the binding point.
+ * @param[in,out] state State cache
+ * @param[in] index Uniform block binding point
+ * @param[in] buffer OpenGL handle to the uniform buffer
+ * @param[in] offset Start of the range in bytes
+ * @param[in] size Size of the range in bytes
+ */
+inline void BindUniformBufferRange(GLStateCache& state, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (index >= static_cast<GLuint>(STATE_CACHE_UNIFORM_BINDINGS))
+	{
+		CountStateCall(state, true);
+		glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+		state.buffers[STATE_BUFFER_UNIFORM] = buffer;
+		return;
+	}
+
+	UniformBufferBinding& binding = state.uniformBindings[index];
+	if (CountStateCall(state, binding.buffer != buffer || binding.offset != offset || binding.size != size))
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+		binding.buffer = buffer;
+		binding.offset = offset;
+		binding.size = size;
+
+		// Binding an indexed range also binds the buffer to the generic target
+		state.buffers[STATE_BUFFER_UNIFORM] = buffer;
+	}
+}
+
+/**
+ * @brief glEnable() or glDisable(), skipped if the capability is already in that state.
+ * @param[in,out] state State cache
+ * @param[in] capability OpenGL capability, as passed to glEnable()
+ * @param[in] enable Whether to enable or disable the capability
+ */
+inline void SetCapability(GLStateCache& state, GLenum capability, bool enable)
+{
+	uint32_t bit = GetStateCapabilityBit(capability);
+	bool known = bit != 0 && (state.unknownCaps & bit) == 0;
+	if (CountStateCall(state, !known || ((state.enabled & bit) != 0) != enable))
+	{
+		if (enable)
+		{
+			glEnable(capability);
+			state.enabled |= bit;
+		}
+		else
+		{
+			glDisable(capability);
+			state.enabled &= ~bit;
+		}
+		state.unknownCaps &= ~bit;
+	}
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// ---------------
+// GPU timer scopes
+// ---------------
+//
+// Each scope writes a GL_TIMESTAMP query when it begins and another when it ends.
+// Timestamps (unlike GL_TIME_ELAPSED) may nest and overlap, so scopes can wrap both a
+// whole pass and the groups inside it. A scope may begin and end several times in a frame,
+// for draws of one group that the render queue did not sort next to each other; the frame's
+// measurement is the sum of its intervals. Every scope owns the query pairs of each frame of
+// a small ring, and results are only read once the GPU reports them available, a few
+// frames later, so reading them never stalls the pipeline.
+
+const int GPU_TIMER_FRAME_LATENCY = 4;
+const size_t GPU_TIMER_HISTORY = 240;
+
+/**
+ * Struct containing one named scope and the history of its measurements
+ */
+struct GpuTimerScope
+{
+	std::string name;
+	std::vector<GLuint> queries[GPU_TIMER_FRAME_LATENCY];	// Begin and end query of each interval, grown on demand
+	size_t intervalCount[GPU_TIMER_FRAME_LATENCY] = {};		// Intervals written and not read back yet
+	bool measured = true;									// Measured during the current frame
+	bool open = false;										// Begun and not ended yet
+
+	// Ring of the last measurements, in milliseconds
+	std::vector<float> history;
+	size_t historyNext = 0;
+};
+
+/**
+ * Struct containing the rolling statistics of a scope, in milliseconds
+ */
+struct GpuTimerStats
+{
+	float min = 0.0f;
+	float avg = 0.0f;
+	float p99 = 0.0f;
+	size_t sampleCount = 0;
+};
+
+/**
+ * Struct containing every GPU timer scope
+ */
+struct GpuTimers
+{
+	std::vector<GpuTimerScope> scopes;
+	int frameSlot = 0;
+	bool enabled = true;
+	size_t historySize = GPU_TIMER_HISTORY;	// Number of measurements the statistics cover
+};
+
+/**
+ * @brief Adds a named scope.
+ * @param[in,out] timers GPU timers
+ * @param[in] name Name of the scope, used in the reports
+ * @return Index of the scope, passed to BeginGpuScope() and EndGpuScope()
+ */
+inline int AddGpuTimerScope(GpuTimers& timers, const std::string& name)
+{
+	GpuTimerScope scope;
+	scope.name = name;
+	for (std::vector<GLuint>& queries : scope.queries)
+	{
+		queries.resize(2);
+		glGenQueries(2, queries.data());
+	}
+	timers.scopes.push_back(scope);
+	return static_cast<int>(timers.scopes.size()) - 1;
+}
+
+/**
+ * @brief Collects the measurements that became available and moves to the next slot of the ring.
+ * Call once at the start of every frame.
+ * @param[in,out] timers GPU timers
+ */
+inline void BeginGpuTimerFrame(GpuTimers& timers)
+{
+	if (!timers.enabled)
+	{
+		return;
+	}
+
+	timers.frameSlot = (timers.frameSlot + 1) % GPU_TIMER_FRAME_LATENCY;
+	for (GpuTimerScope& scope : timers.scopes)
+	{
+		std::vector<GLuint>& queries = scope.queries[timers.frameSlot];
+		size_t& intervalCount = scope.intervalCount[timers.frameSlot];
+		scope.open = false;
+
+		// Results of the frame that used this slot GPU_TIMER_FRAME_LATENCY frames ago.
+		// If they are still not available, the scope is simply not measured this frame.
+		scope.measured = intervalCount == 0;
+		if (scope.measured)
+		{
+			continue;
+		}
+
+		// Timestamps complete in order, so the last one being available means all of them are
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(queries[intervalCount * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available != GL_TRUE)
+		{
+			continue;
+		}
+
+		GLuint64 elapsed = 0;
+		for (size_t i = 0; i < intervalCount; i++)
+		{
+			GLuint64 begin, end;
+			glGetQueryObjectui64v(queries[i * 2], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+			elapsed += end - begin;
+		}
+		intervalCount = 0;
+		scope.measured = true;
+
+		float milliseconds = static_cast<float>(elapsed) / 1000000.0f;
+		if (scope.history.size() < timers.historySize)
+		{
+			scope.history.push_back(milliseconds);
+		}
+		else
+		{
+			scope.history[scope.historyNext] = milliseconds;
+		}
+		scope.historyNext = (scope.historyNext + 1) % timers.historySize;
+	}
+}
+
+/**
+ * @brief Records the GPU time at which an interval of a scope begins. Every interval of a
+ * frame adds to the scope's measurement of that frame.
+ * @param[in,out] timers GPU timers
+ * @param[in] scopeIndex Index returned by AddGpuTimerScope()
+ */
+inline void BeginGpuScope(GpuTimers& timers, int scopeIndex)
+{
+	if (!timers.enabled || scopeIndex < 0)
+	{
+		return;
+	}
+
+	GpuTimerScope& scope = timers.scopes[scopeIndex];
+	if (!scope.measured || scope.open)
+	{
+		return;
+	}
+
+	// More intervals than any frame before, add a query pair for this one
+	std::vector<GLuint>& queries = scope.queries[timers.frameSlot];
+	size_t first = scope.intervalCount[timers.frameSlot] * 2;
+	if (first == queries.size())
+	{
+		queries.resize(first + 2);
+		glGenQueries(2, &queries[first]);
+	}
+	glQueryCounter(queries[first], GL_TIMESTAMP);
+	scope.open = true;
+}
+
+/**
+ * @brief Records the GPU time at which the open interval of a scope ends.
+ * @param[in,out] timers GPU timers
+ * @param[in] scopeIndex Index returned by AddGpuTimerScope()
+ */
+inline void EndGpuScope(GpuTimers& timers, int scopeIndex)
+{
+	if (!timers.enabled || scopeIndex < 0)
+	{
+		return;
+	}
+
+	GpuTimerScope& scope = timers.scopes[scopeIndex];
+	if (!scope.open)
+	{
+		return;
+	}
+	size_t& intervalCount = scope.intervalCount[timers.frameSlot];
+	glQueryCounter(scope.queries[timers.frameSlot][intervalCount * 2 + 1], GL_TIMESTAMP);
+	intervalCount++;
+	scope.open = false;
+}
+
+/**
+ * @brief Computes the rolling statistics of a scope over its history.
+ * @param[in] scope Scope to summarize
+ * @return Minimum, average and 99th percentile of the measurements
+ */
+inline GpuTimerStats GetGpuTimerStats(const GpuTimerScope& scope)
+{
+	GpuTimerStats stats;
+	stats.sampleCount = scope.history.size();
+	if (stats.sampleCount == 0)
+	{
+		return stats;
+	}
+
+	std::vector<float> sorted = scope.history;
+	std::sort(sorted.begin(), sorted.end());
+
+	float sum = 0.0f;
+	for (float sample : sorted)
+	{
+		sum += sample;
+	}
+
+	stats.min = sorted.front();
+	stats.avg = sum / stats.sampleCount;
+	stats.p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+	return stats;
+}
+
+/**
+ * @brief Prints the rolling statistics of every scope.
+ * @param[in] timers GPU timers
+ */
+inline void PrintGpuTimerReport(const GpuTimers& timers)
+{
+	std::printf("GPU time (ms)            min      avg      p99\n");
+	for (const GpuTimerScope& scope : timers.scopes)
+	{
+		GpuTimerStats stats = GetGpuTimerStats(scope);
+		std::printf("  %-20s %8.3f %8.3f %8.3f\n", scope.name.c_str(), stats.min, stats.avg, stats.p99);
+	}
+}
+
+/**
+ * @brief Deletes the queries of every scope.
+ * @param[in,out] timers GPU timers
+ */
+inline void DeleteGpuTimers(GpuTimers& timers)
+{
+	for (GpuTimerScope& scope : timers.scopes)
+	{
+		for (std::vector<GLuint>& queries : scope.queries)
+		{
+			glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+		}
+	}
+	timers.scopes.clear();
+}
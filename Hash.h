@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ---------------
+// Hashing for on-disk caches
+// ---------------
+
+const uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+const uint64_t FNV1A_PRIME = 1099511628211ull;
+
+/**
+ * @brief Adds bytes to a 64-bit FNV-1a hash.
+ * @param[in] data Pointer to the bytes
+ * @param[in] size Number of bytes
+ * @param[in] hash Hash so far, FNV1A_OFFSET_BASIS to start a new one
+ * @return Updated hash
+ */
+inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV1A_PRIME;
+	}
+	return hash;
+}
+
+/**
+ * @brief Adds a string to a 64-bit FNV-1a hash, followed by a terminating zero so that
+ * consecutive strings cannot be confused with their concatenation.
+ * @param[in] text String to add
+ * @param[in] hash Hash so far, FNV1A_OFFSET_BASIS to start a new one
+ * @return Updated hash
+ */
+inline uint64_t HashString(const std::string& text, uint64_t hash = FNV1A_OFFSET_BASIS)
+{
+	hash = HashBytes(text.data(), text.size(), hash);
+	return HashBytes("", 1, hash);
+}
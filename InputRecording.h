@@ -0,0 +1,301 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// ---------------
+// Input recording and replay
+// ---------------
+//
+// A recording stores, for every frame, the frame clock, the state of the keys the camera
+// reads and the cursor/scroll events received since the previous frame. Replaying feeds
+// the same values back in the same order, with the recorded clock standing in for
+// glfwGetTime(), so the camera and the animated lights follow the session frame for frame.
+//
+// File layout: InputRecordingHeader, then per frame an InputFrameHeader followed by
+// eventCount InputEvent entries. All values are little-endian, as written by the recorder.
+
+const char INPUT_RECORDING_MAGIC[4] = { 'I', 'N', 'P', 'R' };
+const uint32_t INPUT_RECORDING_VERSION = 1;
+
+/**
+ * Bits of the key mask stored per frame
+ */
+enum InputKey : uint32_t
+{
+	INPUT_KEY_ESCAPE = 1u << 0,
+	INPUT_KEY_W = 1u << 1,
+	INPUT_KEY_A = 1u << 2,
+	INPUT_KEY_S = 1u << 3,
+	INPUT_KEY_D = 1u << 4
+};
+
+/**
+ * Types of the events stored between frames
+ */
+enum InputEventType : uint32_t
+{
+	INPUT_EVENT_CURSOR = 0,		// x, y - cursor position
+	INPUT_EVENT_SCROLL = 1		// x, y - scroll offsets
+};
+
+/**
+ * Header at the start of a recording
+ */
+struct InputRecordingHeader
+{
+	char magic[4];
+	uint32_t version;
+	double startTime;	// Clock value before the first frame, so the first frame's delta replays too
+};
+
+/**
+ * Header of one recorded frame
+ */
+struct InputFrameHeader
+{
+	double time;
+	uint32_t keys;
+	uint32_t eventCount;
+};
+
+/**
+ * One recorded cursor or scroll event. The callbacks convert their doubles to float
+ * before using them, so storing floats replays the exact same values.
+ */
+struct InputEvent
+{
+	uint32_t type;
+	float x;
+	float y;
+};
+
+static_assert(sizeof(InputRecordingHeader) == 16, "InputRecordingHeader is written as is");
+static_assert(sizeof(InputFrameHeader) == 16, "InputFrameHeader is written as is");
+static_assert(sizeof(InputEvent) == 12, "InputEvent is written as is");
+
+/**
+ * Struct containing a recording being written
+ */
+struct InputRecorder
+{
+	std::ofstream file;
+	std::vector<InputEvent> pendingEvents;	// Events received since the last recorded frame
+	bool active = false;
+};
+
+/**
+ * Struct containing a recording being replayed
+ */
+struct InputReplay
+{
+	MappedFile file;
+	size_t offset = 0;
+	double startTime = 0.0;
+	bool active = false;
+};
+
+/**
+ * Struct containing one frame read from a recording
+ */
+struct InputFrame
+{
+	double time = 0.0;
+	uint32_t keys = 0;
+	std::vector<InputEvent> events;
+};
+
+/**
+ * @brief Reads the state of the keys the camera uses.
+ * @param[in] window Window receiving the input
+ * @return Mask of InputKey bits of the pressed keys
+ */
+inline uint32_t GetInputKeyMask(GLFWwindow* window)
+{
+	uint32_t keys = 0;
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+	{
+		keys |= INPUT_KEY_ESCAPE;
+	}
+	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+	{
+		keys |= INPUT_KEY_W;
+	}
+	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+	{
+		keys |= INPUT_KEY_A;
+	}
+	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+	{
+		keys |= INPUT_KEY_S;
+	}
+	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+	{
+		keys |= INPUT_KEY_D;
+	}
+	return keys;
+}
+
+/**
+ * @brief Creates a recording file and writes its header.
+ * @param[out] recorder Recorder to start
+ * @param[in] filePath Path to the recording
+ * @param[in] startTime Clock value before the first frame
+ * @return True if the file could be created, false otherwise
+ */
+inline bool StartInputRecording(InputRecorder& recorder, const std::string& filePath, double startTime)
+{
+	recorder.file.open(filePath, std::ios::binary | std::ios::trunc);
+	if (recorder.file.fail())
+	{
+		std::cerr << "Unable to create input recording: " << filePath << std::endl;
+		return false;
+	}
+
+	InputRecordingHeader header = {};
+	std::memcpy(header.magic, INPUT_RECORDING_MAGIC, sizeof(header.magic));
+	header.version = INPUT_RECORDING_VERSION;
+	header.startTime = startTime;
+	recorder.file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	recorder.active = true;
+	return true;
+}
+
+/**
+ * @brief Stores an event until the next frame is recorded. Does nothing if the recorder is not active.
+ * @param[in,out] recorder Recorder
+ * @param[in] type Type of the event
+ * @param[in] x First value of the event
+ * @param[in] y Second value of the event
+ */
+inline void RecordInputEvent(InputRecorder& recorder, InputEventType type, float x, float y)
+{
+	if (recorder.active)
+	{
+		recorder.pendingEvents.push_back({ type, x, y });
+	}
+}
+
+/**
+ * @brief Writes a frame with the events received since the previous one.
+ * Does nothing if the recorder is not active.
+ * @param[in,out] recorder Recorder
+ * @param[in] time Clock value of the frame
+ * @param[in] keys Mask of InputKey bits of the pressed keys
+ */
+inline void RecordInputFrame(InputRecorder& recorder, double time, uint32_t keys)
+{
+	if (!recorder.active)
+	{
+		return;
+	}
+
+	InputFrameHeader header = {};
+	header.time = time;
+	header.keys = keys;
+	header.eventCount = static_cast<uint32_t>(recorder.pendingEvents.size());
+	recorder.file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	recorder.file.write(reinterpret_cast<const char*>(recorder.pendingEvents.data()), recorder.pendingEvents.size() * sizeof(InputEvent));
+	recorder.pendingEvents.clear();
+}
+
+/**
+ * @brief Closes the recording file.
+ * @param[in,out] recorder Recorder to stop
+ */
+inline void StopInputRecording(InputRecorder& recorder)
+{
+	if (recorder.active)
+	{
+		recorder.file.close();
+		recorder.active = false;
+	}
+}
+
+/**
+ * @brief Opens a recording for replay and checks its header.
+ * @param[out] replay Replay to open
+ * @param[in] filePath Path to the recording
+ * @return True if the recording could be opened, false otherwise
+ */
+inline bool OpenInputReplay(InputReplay& replay, const std::string& filePath)
+{
+	if (!MapFile(filePath, replay.file))
+	{
+		std::cerr << "Unable to open input recording: " << filePath << std::endl;
+		return false;
+	}
+
+	InputRecordingHeader header;
+	if (replay.file.size < sizeof(header))
+	{
+		std::cerr << "Invalid input recording: " << filePath << std::endl;
+		UnmapFile(replay.file);
+		return false;
+	}
+	std::memcpy(&header, replay.file.data, sizeof(header));
+	if (std::memcmp(header.magic, INPUT_RECORDING_MAGIC, sizeof(header.magic)) != 0 || header.version != INPUT_RECORDING_VERSION)
+	{
+		std::cerr << "Invalid input recording: " << filePath << std::endl;
+		UnmapFile(replay.file);
+		return false;
+	}
+
+	replay.startTime = header.startTime;
+	replay.offset = sizeof(header);
+	replay.active = true;
+	return true;
+}
+
+/**
+ * @brief Reads the next frame of a recording.
+ * @param[in,out] replay Replay to read from
+ * @param[out] frame Recorded frame
+ * @return True if a frame was read, false at the end of the recording
+ */
+inline bool ReadInputFrame(InputReplay& replay, InputFrame& frame)
+{
+	InputFrameHeader header;
+	if (replay.file.size - replay.offset < sizeof(header))
+	{
+		return false;
+	}
+
+	// Frames are not aligned in the file, so copy instead of pointing into the mapping
+	std::memcpy(&header, replay.file.data + replay.offset, sizeof(header));
+	size_t eventBytes = static_cast<size_t>(header.eventCount) * sizeof(InputEvent);
+	if (replay.file.size - replay.offset - sizeof(header) < eventBytes)
+	{
+		return false;
+	}
+
+	frame.time = header.time;
+	frame.keys = header.keys;
+	frame.events.resize(header.eventCount);
+	if (eventBytes > 0)
+	{
+		std::memcpy(frame.events.data(), replay.file.data + replay.offset + sizeof(header), eventBytes);
+	}
+
+	replay.offset += sizeof(header) + eventBytes;
+	return true;
+}
+
+/**
+ * @brief Closes a recording opened for replay.
+ * @param[in,out] replay Replay to close
+ */
+inline void CloseInputReplay(InputReplay& replay)
+{
+	UnmapFile(replay.file);
+	replay = InputReplay();
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.h"
+
+// ---------------
+// Instanced rendering of the torii gate
+// ---------------
+
+/**
+ * Struct containing the per-instance data read by instanced.vsh
+ */
+struct InstanceData
+{
+	glm::mat4 model;		// Attributes 4 to 7 - Model matrix columns
+	glm::vec3 norm[3];		// Attributes 8 to 10 - Normal matrix columns
+	GLint texIndex;			// Attribute 11 - Layer of the material array
+};
+
+/**
+ * Struct containing one part of a torii gate, relative to the origin of the gate
+ */
+struct ToriiGatePart
+{
+	glm::mat4 model;
+	GLint texIndex;
+	uint32_t flags = 0;		// SceneObjectFlags of the part besides SCENE_OBJECT_GATE_PART
+};
+
+/**
+ * @brief Places gates on a square grid that starts at the original gate and extends away from the camera.
+ * @param[in] gateCount Number of gates
+ * @param[in] spacingX Distance between two gates along the x axis
+ * @param[in] spacingZ Distance between two gates along the z axis
+ * @return Transform of every gate
+ */
+inline std::vector<glm::mat4> GetGateGridTransforms(int gateCount, float spacingX, float spacingZ)
+{
+	std::vector<glm::mat4> gates;
+	gates.reserve(gateCount);
+
+	int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(gateCount))));
+	for (int i = 0; i < gateCount; i++)
+	{
+		int column = i % columns;
+		int row = i / columns;
+
+		// Alternate columns left and right of the original gate so the grid stays centered
+		float x = ((column + 1) / 2) * spacingX * ((column % 2 == 0) ? 1.0f : -1.0f);
+		float z = -row * spacingZ;
+		gates.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z)));
+	}
+
+	return gates;
+}
+
+/**
+ * @brief Builds the instance data of every part of every gate.
+ * @param[in] gates Transform of every gate
+ * @param[in] parts Parts of one gate, relative to the gate's origin
+ * @return Instance data, with the parts of each gate stored next to each other
+ */
+inline std::vector<InstanceData> BuildGateInstances(const std::vector<glm::mat4>& gates, const std::vector<ToriiGatePart>& parts)
+{
+	std::vector<InstanceData> instances;
+	instances.reserve(gates.size() * parts.size());
+	for (const glm::mat4& gate : gates)
+	{
+		for (const ToriiGatePart& part : parts)
+		{
+			InstanceData instance;
+			instance.model = gate * part.model;
+
+			glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(instance.model)));
+			instance.norm[0] = normalMatrix[0];
+			instance.norm[1] = normalMatrix[1];
+			instance.norm[2] = normalMatrix[2];
+
+			instance.texIndex = part.texIndex;
+			instances.push_back(instance);
+		}
+	}
+
+	return instances;
+}
+
+/**
+ * @brief Creates a vertex array object that reads per-vertex data from a mesh and per-instance data from another buffer.
+ * @param[in] mesh Mesh providing the vertex and element buffers
+ * @param[in] instanceBuffer OpenGL handle to the buffer containing the InstanceData entries
+ * @return OpenGL handle to the created vertex array object
+ */
+inline GLuint CreateInstancedVertexArray(const Mesh& mesh, GLuint instanceBuffer)
+{
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	SetMeshVertexAttributes(mesh);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+	// Instance attributes 4 to 7 - Model matrix, one column per attribute
+	for (GLuint column = 0; column < 4; column++)
+	{
+		glEnableVertexAttribArray(4 + column);
+		glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, model) + sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(4 + column, 1);
+	}
+
+	// Instance attributes 8 to 10 - Normal matrix, one column per attribute
+	for (GLuint column = 0; column < 3; column++)
+	{
+		glEnableVertexAttribArray(8 + column);
+		glVertexAttribPointer(8 + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, norm) + sizeof(glm::vec3) * column));
+		glVertexAttribDivisor(8 + column, 1);
+	}
+
+	// Instance attribute 11 - Material layer, read as an integer
+	glEnableVertexAttribArray(11);
+	glVertexAttribIPointer(11, 1, GL_INT, sizeof(InstanceData), (void*)(offsetof(InstanceData, texIndex)));
+	glVertexAttribDivisor(11, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return vao;
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "FrustumCulling.h"
+#include "Mesh.h"
+#include "Scene.h"
+#include "SceneGraph.h"
+#include "Vertex.h"
+
+// ---------------
+// Level of detail
+// ---------------
+//
+// An object with detail levels picks one every frame from how large it appears on screen:
+// the radius of its world bounds over its distance from the camera, relative to the half
+// height of the view. Each level is used down to a minimum screen size, and an object only
+// moves to another level once it is a margin past the threshold, so objects sitting right at
+// a threshold do not flicker between two levels.
+//
+// The levels of the kasagi, the top roof beam of a torii gate, are generated on load: the
+// closer ones bend the beam so its ends rise, with fewer segments the further away, and
+// the last one is the object's own cube from the scene file.
+
+const int LOD_MAX_LEVELS = 4;
+const float LOD_HYSTERESIS = 0.15f;		// Fraction a screen size has to go past a threshold to switch levels
+
+// Kasagi, in the model space of the gate part cube: thickness along x, length along y, depth along z
+const float KASAGI_CURVE = 1.0f;		// How far the ends rise along x, half the thickness of the beam
+const int KASAGI_SEGMENTS[] = { 16, 4 };
+const float KASAGI_MIN_SCREEN_SIZES[] = { 0.4f, 0.2f };
+
+/**
+ * Struct containing one detail level of an object
+ */
+struct LodLevel
+{
+	const Mesh* mesh = nullptr;
+	MeshRange range;
+	float minScreenSize = 0.0f;		// Smallest screen size the level is used at
+};
+
+/**
+ * Struct containing the detail levels of one kind of object, the most detailed first
+ */
+struct LodMesh
+{
+	LodLevel levels[LOD_MAX_LEVELS];
+	int levelCount = 0;
+	Bounds bounds;		// Bounds of every level in model space
+};
+
+/**
+ * Struct containing the generated levels and the level each object currently uses
+ */
+struct LodLibrary
+{
+	std::vector<Vertex> vertices;
+	std::vector<GLushort> indices;
+	Mesh mesh;							// Geometry of every generated level
+
+	std::vector<LodMesh> objectLods;	// Per scene object, levelCount is 0 for objects with a single level
+	std::vector<int> objectLevels;		// Level each scene object used on the last frame
+};
+
+/**
+ * @brief Appends a white vertex, so the material alone gives the color.
+ * @param[in,out] vertices Vertices to append to
+ * @param[in] position Position in model space
+ * @param[in] u Texture coordinate along the length
+ * @param[in] v Texture coordinate across
+ * @param[in] normal Normal in model space
+ */
+inline void AppendLodVertex(std::vector<Vertex>& vertices, const glm::vec3& position, float u, float v, const glm::vec3& normal)
+{
+	vertices.push_back({ position.x, position.y, position.z, 255, 255, 255, u, v, normal.x, normal.y, normal.z });
+}
+
+/**
+ * @brief Appends a kasagi bent along its length, in the model space of the gate part cube.
+ * Every face of every segment is a 4-vertex strip, like the faces of the cube.
+ * @param[in,out] vertices Vertices to append to
+ * @param[in,out] indices Indices to append to
+ * @param[in] segments Number of segments along the length
+ * @return Range of the appended indices
+ */
+inline MeshRange AppendKasagiBeam(std::vector<Vertex>& vertices, std::vector<GLushort>& indices, int segments)
+{
+	const float xMin = -5.0f, xMax = -3.0f, yMin = 1.0f, yMax = 3.0f, zMin = 0.0f, zMax = 2.0f;
+	GLushort firstVertex = static_cast<GLushort>(vertices.size());
+
+	// The beam rises by curve * t^2, t going from -1 to 1 along its length of 2, so the x faces
+	// lean with the slope and their normals tilt against it
+	for (int s = 0; s < segments; s++)
+	{
+		float t0 = -1.0f + 2.0f * s / segments, t1 = -1.0f + 2.0f * (s + 1) / segments;
+		float y0 = yMin + (t0 + 1.0f) * 0.5f * (yMax - yMin), y1 = yMin + (t1 + 1.0f) * 0.5f * (yMax - yMin);
+		float r0 = KASAGI_CURVE * t0 * t0, r1 = KASAGI_CURVE * t1 * t1;
+		float u0 = static_cast<float>(s) / segments, u1 = static_cast<float>(s + 1) / segments;
+		glm::vec3 n0 = glm::normalize(glm::vec3(1.0f, -2.0f * KASAGI_CURVE * t0, 0.0f));
+		glm::vec3 n1 = glm::normalize(glm::vec3(1.0f, -2.0f * KASAGI_CURVE * t1, 0.0f));
+
+		// Right
+		AppendLodVertex(vertices, glm::vec3(xMax + r0, y0, zMin), u0, 0.0f, n0);
+		AppendLodVertex(vertices, glm::vec3(xMax + r1, y1, zMin), u1, 0.0f, n1);
+		AppendLodVertex(vertices, glm::vec3(xMax + r0, y0, zMax), u0, 1.0f, n0);
+		AppendLodVertex(vertices, glm::vec3(xMax + r1, y1, zMax), u1, 1.0f, n1);
+		// Left
+		AppendLodVertex(vertices, glm::vec3(xMin + r0, y0, zMax), u0, 0.0f, -n0);
+		AppendLodVertex(vertices, glm::vec3(xMin + r1, y1, zMax), u1, 0.0f, -n1);
+		AppendLodVertex(vertices, glm::vec3(xMin + r0, y0, zMin), u0, 1.0f, -n0);
+		AppendLodVertex(vertices, glm::vec3(xMin + r1, y1, zMin), u1, 1.0f, -n1);
+		// Front
+		AppendLodVertex(vertices, glm::vec3(xMax + r0, y0, zMax), u0, 0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+		AppendLodVertex(vertices, glm::vec3(xMax + r1, y1, zMax), u1, 0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+		AppendLodVertex(vertices, glm::vec3(xMin + r0, y0, zMax), u0, 1.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+		AppendLodVertex(vertices, glm::vec3(xMin + r1, y1, zMax), u1, 1.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+		// Back
+		AppendLodVertex(vertices, glm::vec3(xMin + r0, y0, zMin), u0, 0.0f, glm::vec3(0.0f, 0.0f, -1.0f));
+		AppendLodVertex(vertices, glm::vec3(xMin + r1, y1, zMin), u1, 0.0f, glm::vec3(0.0f, 0.0f, -1.0f));
+		AppendLodVertex(vertices, glm::vec3(xMax + r0, y0, zMin), u0, 1.0f, glm::vec3(0.0f, 0.0f, -1.0f));
+		AppendLodVertex(vertices, glm::vec3(xMax + r1, y1, zMin), u1, 1.0f, glm::vec3(0.0f, 0.0f, -1.0f));
+	}
+
+	// Both ends, where the beam has risen by the whole curve
+	float rise = KASAGI_CURVE;
+	AppendLodVertex(vertices, glm::vec3(xMin + rise, yMin, zMin), 0.0f, 0.0f, glm::vec3(0.0f, -1.0f, 0.0f));
+	AppendLodVertex(vertices, glm::vec3(xMax + rise, yMin, zMin), 1.0f, 0.0f, glm::vec3(0.0f, -1.0f, 0.0f));
+	AppendLodVertex(vertices, glm::vec3(xMin + rise, yMin, zMax), 0.0f, 1.0f, glm::vec3(0.0f, -1.0f, 0.0f));
+	AppendLodVertex(vertices, glm::vec3(xMax + rise, yMin, zMax), 1.0f, 1.0f, glm::vec3(0.0f, -1.0f, 0.0f));
+	AppendLodVertex(vertices, glm::vec3(xMin + rise, yMax, zMin), 0.0f, 0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	AppendLodVertex(vertices, glm::vec3(xMin + rise, yMax, zMax), 0.0f, 1.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	AppendLodVertex(vertices, glm::vec3(xMax + rise, yMax, zMin), 1.0f, 0.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	AppendLodVertex(vertices, glm::vec3(xMax + rise, yMax, zMax), 1.0f, 1.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+
+	return AppendQuadStripIndices(indices, firstVertex, segments * 4 + 2);
+}
+
+/**
+ * @brief Generates the detail levels of the scene objects that have any, and uploads them.
+ * @param[out] library Library of detail levels. The generated levels point into it, so it must not be moved afterwards.
+ * @param[in] scene Loaded scene
+ * @param[in] sceneMesh Mesh of the scene, holding the last level of every object
+ * @param[in] layout Layout to store the generated vertices in, the same as the scene mesh's since the levels share its programs
+ * @param[in] streams Whether the generated positions get a buffer of their own
+ */
+inline void InitLodLibrary(LodLibrary& library, const Scene& scene, const Mesh& sceneMesh, VertexLayout layout, VertexStreams streams)
+{
+	library.objectLods.assign(scene.objectCount, LodMesh());
+	library.objectLevels.assign(scene.objectCount, 0);
+
+	LodMesh kasagi;
+	for (int segments : KASAGI_SEGMENTS)
+	{
+		LodLevel& level = kasagi.levels[kasagi.levelCount];
+		level.mesh = &library.mesh;
+		level.range = AppendKasagiBeam(library.vertices, library.indices, segments);
+		level.minScreenSize = KASAGI_MIN_SCREEN_SIZES[kasagi.levelCount];
+		kasagi.levelCount++;
+	}
+	kasagi.bounds = GetRangeBounds(library.vertices.data(), library.indices.data(), kasagi.levels[0].range);
+
+	for (size_t i = 0; i < scene.objectCount; i++)
+	{
+		const SceneObjectRecord& object = scene.objects[i];
+		if (object.flags & SCENE_OBJECT_KASAGI)
+		{
+			// The cube from the scene file is the last level, used at any size
+			LodMesh& lods = library.objectLods[i];
+			lods = kasagi;
+			lods.levels[lods.levelCount].mesh = &sceneMesh;
+			lods.levels[lods.levelCount].range = GetObjectRange(object);
+			lods.levels[lods.levelCount].minScreenSize = 0.0f;
+			lods.levelCount++;
+			lods.bounds = MergeBounds(kasagi.bounds, GetRangeBounds(scene.vertices, scene.indices, GetObjectRange(object)));
+		}
+	}
+
+	library.mesh = CreateMesh(library.vertices.data(), library.vertices.size(), library.indices.data(), library.indices.size(), layout, streams);
+}
+
+/**
+ * @brief Widens the bounds of the scene graph's objects to hold all their detail levels,
+ * so culling is correct whichever level is drawn.
+ * @param[in,out] graph Scene graph, updated on the next UpdateSceneGraph()
+ * @param[in] library Library of detail levels
+ */
+inline void ExtendSceneBoundsToLods(SceneGraph& graph, const LodLibrary& library)
+{
+	for (size_t i = 0; i < library.objectLods.size(); i++)
+	{
+		int node = graph.objectNodes[i];
+		if (library.objectLods[i].levelCount > 0 && node >= 0)
+		{
+			graph.nodes[node].bounds = MergeBounds(graph.nodes[node].bounds, library.objectLods[i].bounds);
+			graph.dirtyNodes.push_back(node);
+		}
+	}
+}
+
+/**
+ * @brief Gets how large a box appears on screen.
+ * @param[in] bounds World bounds
+ * @param[in] cameraPos Position of the camera
+ * @param[in] tanHalfFov Tangent of half the vertical field of view
+ * @return Radius of the bounds over the half height of the view at their distance, 1 or more if they fill the view
+ */
+inline float GetScreenSize(const Bounds& bounds, const glm::vec3& cameraPos, float tanHalfFov)
+{
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+	float distance = glm::length(center - cameraPos);
+	if (distance <= radius)
+	{
+		return 1.0f / tanHalfFov;
+	}
+	return radius / (distance * tanHalfFov);
+}
+
+/**
+ * @brief Picks the level of an object from its screen size, with hysteresis around the thresholds.
+ * @param[in] lods Detail levels of the object
+ * @param[in] screenSize Screen size of the object, see GetScreenSize()
+ * @param[in] current Level the object used so far
+ * @return Level to use
+ */
+inline int SelectLodLevel(const LodMesh& lods, float screenSize, int current)
+{
+	int level = std::min(std::max(current, 0), lods.levelCount - 1);
+	while (level > 0 && screenSize >= lods.levels[level - 1].minScreenSize * (1.0f + LOD_HYSTERESIS))
+	{
+		level--;
+	}
+	while (level < lods.levelCount - 1 && screenSize < lods.levels[level].minScreenSize * (1.0f - LOD_HYSTERESIS))
+	{
+		level++;
+	}
+	return level;
+}
+
+/**
+ * @brief Updates the level of an object and gets what to draw for it.
+ * @param[in,out] library Library of detail levels
+ * @param[in] object Index of the scene object
+ * @param[in] bounds World bounds of the object
+ * @param[in] cameraPos Position of the camera
+ * @param[in] tanHalfFov Tangent of half the vertical field of view
+ * @param[out] level Level to draw, only set if the object has detail levels
+ * @return True if the object has detail levels, false if it is drawn as stored in the scene
+ */
+inline bool GetObjectLod(LodLibrary& library, int object, const Bounds& bounds, const glm::vec3& cameraPos, float tanHalfFov, LodLevel& level)
+{
+	const LodMesh& lods = library.objectLods[object];
+	if (lods.levelCount == 0)
+	{
+		return false;
+	}
+
+	int& current = library.objectLevels[object];
+	current = SelectLodLevel(lods, GetScreenSize(bounds, cameraPos, tanHalfFov), current);
+	level = lods.levels[current];
+	return true;
+}
+
+/**
+ * @brief Deletes the generated levels.
+ * @param[in,out] library Library of detail levels to delete
+ */
+inline void DeleteLodLibrary(LodLibrary& library)
+{
+	DeleteMesh(library.mesh);
+	library = LodLibrary();
+}
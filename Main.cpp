@@ -6,10 +6,43 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <string>
-
+#include <thread>
+#include <vector>
+
+#include "BenchMode.h"
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "DefaultScene.h"
+#include "ForestScene.h"
+#include "FrustumCulling.h"
+#include "GLState.h"
+#include "GpuTimers.h"
+#include "InputRecording.h"
+#include "Instancing.h"
+#include "LevelOfDetail.h"
+#include "MaterialArray.h"
+#include "OcclusionCulling.h"
+#include "ProgramCache.h"
+#include "RenderQueue.h"
+#include "Scene.h"
+#include "SceneGraph.h"
+#include "ShaderLibrary.h"
+#include "ShaderPermutations.h"
+#include "TextureLoader.h"
+#include "TransformBatch.h"
+#include "UniformBuffers.h"
+#include "Vertex.h"
+
+// The project headers only use the stb_image declarations, so the implementation
+// is compiled here, after all of them
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -18,50 +51,74 @@
 // ---------------
 
 /**
- * @brief Creates a shader program based on the provided file paths for the vertex and fragment shaders.
- * @param[in] vertexShaderFilePath Vertex shader file path
- * @param[in] fragmentShaderFilePath Fragment shader file path
- * @return OpenGL handle to the created shader program
+ * @brief Function for handling the event when the size of the framebuffer changed.
+ * @param[in] window Reference to the window
+ * @param[in] width New width
+ * @param[in] height New height
  */
-GLuint CreateShaderProgram(const std::string& vertexShaderFilePath, const std::string& fragmentShaderFilePath);
+void FramebufferSizeChangedCallback(GLFWwindow* window, int width, int height);
 
 /**
- * @brief Creates a shader based on the provided shader type and the path to the file containing the shader source.
- * @param[in] shaderType Shader type
- * @param[in] shaderFilePath Path to the file containing the shader source
- * @return OpenGL handle to the created shader
+ * Struct containing the options passed on the command line
  */
-GLuint CreateShaderFromFile(const GLuint& shaderType, const std::string& shaderFilePath);
+struct AppOptions
+{
+	bool instanced = false;	// --instanced: draw the torii gates with a single instanced draw call
+	int gateCount = 1;		// --gates N: number of gates drawn by the instanced path
+	std::string scenePath = "shrine.scene";	// --scene PATH: scene file to load, created from the default scene if missing or outdated
+
+	// Procedural stress scene, see ForestScene.h
+	int forestGates = 0;	// --forest N: generate a forest of N gates into the scene file (forest.scene unless --scene is given) on every launch
+	int forestLights = 0;	// --forest-lights N: number of lanterns of the forest
+	int forestTextures = 1;	// --forest-textures N: number of texture variants the forest's gates cycle through
+
+	VertexLayout vertexLayout = VERTEX_LAYOUT_FLOAT;	// --packed-vertices: upload the meshes as PackedVertex, 20 bytes per vertex instead of 36
+	VertexStreams vertexStreams = VERTEX_STREAMS_INTERLEAVED;	// --split-streams: store the positions in a buffer of their own, so depth-only draws fetch nothing else
+	bool depthPrepass = false;	// --depth-prepass: draw the depth of the opaque objects first, so the opaque pass shades each pixel once
+	bool compressTextures = false;	// --compress-textures: store textures block-compressed, in the format the driver picks
+	int materialSize = 512;	// --material-size N: width and height every scene texture is resampled to
+	bool gpuTimers = false;	// --gpu-timers: time the render passes on the GPU and print the results every second
+	int lightCount = 0;		// --lights N: number of lanterns scattered around the shrine, on top of the scene's point lights
+	RendererType renderer = RENDERER_FORWARD;	// --renderer forward|deferred: how the lights are shaded
+	bool occlusionCulling = false;	// --occlusion-culling: skip objects whose bounding box was hidden on the previous frame
+	int benchTransforms = 0;	// --bench-transforms [N]: time the batch transform stage against per-object glm for N objects (10000 by default), print the results as JSON and exit
+
+	// Headless benchmark, see BenchMode.h
+	bool bench = false;		// --bench: render offscreen along a scripted camera path, print the results as JSON and exit
+	int benchFrames = 600;	// --bench-frames N: number of frames to render
+	int benchWidth = 1280;	// --bench-size WxH: resolution of the offscreen framebuffer
+	int benchHeight = 720;
+	BenchContext benchContext = BENCH_CONTEXT_NATIVE;	// --bench-context native|egl|osmesa: context creation backend
+
+	// Input recording, see InputRecording.h
+	std::string recordPath;	// --record PATH: record the frame clock and input of the session
+	std::string replayPath;	// --replay PATH: replay a recorded session instead of reading live input
+};
 
 /**
- * @brief Creates a shader based on the provided shader type and the string containing the shader source.
- * @param[in] shaderType Shader type
- * @param[in] shaderSource Shader source string
- * @return OpenGL handle to the created shader
+ * @brief Parses the command line arguments.
+ * @param[in] argc Number of arguments
+ * @param[in] argv Argument strings
+ * @return Parsed options, with defaults for anything not specified
  */
-GLuint CreateShaderFromSource(const GLuint& shaderType, const std::string& shaderSource);
+AppOptions ParseCommandLine(int argc, char* argv[]);
 
-/**
- * @brief Function for handling the event when the size of the framebuffer changed.
- * @param[in] window Reference to the window
- * @param[in] width New width
- * @param[in] height New height
- */
-void FramebufferSizeChangedCallback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void processInput(GLFWwindow* window);
+void processInput(GLFWwindow* window, uint32_t keys);
 
 /**
- * Struct containing data about a vertex
+ * @brief Turns the camera towards a new cursor position. Called for live and replayed cursor events.
+ * @param[in] xpos Cursor x position
+ * @param[in] ypos Cursor y position
  */
-struct Vertex
-{
-	GLfloat x, y, z;	// Position
-	GLubyte r, g, b;	// Color
-	GLfloat u, v;		// UV coordinates
-	GLfloat nx, ny, nz; // Normal Vectors
-};
+void ApplyCursorInput(float xpos, float ypos);
+
+/**
+ * @brief Zooms the camera. Called for live and replayed scroll events.
+ * @param[in] yoffset Vertical scroll offset
+ */
+void ApplyScrollInput(float yoffset);
 
 //Global Variable Declarations for Rotation and Lighting
 glm::vec3 cameraPos = glm::vec3(0.0f, 15.0f, 30.0f);
@@ -78,22 +135,12 @@ float fov = 45.0f;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-// Global Light Specs
-glm::vec3 ambient = glm::vec3(0.1f, 0.1f, 0.1f);
-glm::vec3 diffuse = glm::vec3(0.9f, 0.9f, 0.9f);
-glm::vec3 specular = glm::vec3(0.2f, 0.1f, 0.2f);
+// Position of the global light, orbiting the scene
 glm::vec3 lightPos = glm::vec3(0.0f, 10.0f, 10.0f);
-glm::vec3 specComp = glm::vec3(0.9f, 0.0f, 0.0f);
 
-// Candle Spotlight *change to orange color*
-glm::vec3 ambientSpot = glm::vec3(1.0f, 0.65f, 0.0f);
-glm::vec3 diffuseSpot = glm::vec3(0.9f, 0.9f, 0.9f);
-glm::vec3 specularSpot = glm::vec3(0.2f, 0.1f, 0.2f);
-glm::vec3 lightPosSpot = glm::vec3(-1.0f, 0.0f, -3.5f);
-glm::vec3 specCompSpot = glm::vec3(0.9f, 0.0f, 0.0f);
-float constantSpot = 1.0f;
-float linearSpot = 0.09f;
-float quadraticSpot = 0.032f;
+// Input recording and replay. While replaying, live input is ignored.
+InputRecorder inputRecorder;
+InputReplay inputReplay;
 
 
 /**
@@ -106,8 +153,22 @@ float quadraticSpot = 0.032f;
 void parameter(float) {
 
 }
-int main()
+int main(int argc, char* argv[])
 {
+	AppOptions options = ParseCommandLine(argc, argv);
+
+	// The transform microbenchmark runs on the CPU alone, no window needed
+	if (options.benchTransforms > 0)
+	{
+		RunTransformBenchmark(static_cast<size_t>(options.benchTransforms), 200);
+		return 0;
+	}
+
+	if (options.bench)
+	{
+		SetBenchInitHints(options.benchContext);
+	}
+
 	// Initialize GLFW
 	int glfwInitStatus = glfwInit();
 	if (glfwInitStatus == GLFW_FALSE)
@@ -124,6 +185,12 @@ int main()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+	// The benchmark never shows its window, it renders into its own framebuffer
+	if (options.bench)
+	{
+		SetBenchWindowHints(options.benchContext);
+	}
+
 	// Tell GLFW to create a window
 	int windowWidth = 800;
 	int windowHeight = 600;
@@ -151,255 +218,131 @@ int main()
 		return 1;
 	}
 
+	// --- Scene ---
+
+	// The scene file is mapped and used in place. When it does not exist yet, or was written
+	// by a build with another version of the format, the built-in shrine is written out first
+	// so later launches load it directly.
+	Scene scene;
+	if (options.forestGates > 0)
+	{
+		std::cerr << "Writing a forest of " << options.forestGates << " gates to " << options.scenePath << std::endl;
+		WriteSceneFile(options.scenePath, BuildForestScene(options.forestGates, options.forestLights, options.forestTextures));
+	}
+	else if (!std::ifstream(options.scenePath).good() || IsSceneFileOutdated(options.scenePath))
+	{
+		std::cerr << "Writing default scene to " << options.scenePath << std::endl;
+		WriteSceneFile(options.scenePath, BuildDefaultScene());
+	}
+	if (!LoadScene(options.scenePath, scene))
+	{
+		std::cerr << "Failed to load scene: " << options.scenePath << std::endl;
+		glfwTerminate();
+		return 1;
+	}
+
 	// --- Vertex specification ---
-	
-	// Set up the data for each vertex of the triangle
-	Vertex vertices[40];
-	//Front Facing Square
-	vertices[0].x = -3.0f;	vertices[0].y = 1.0f;	vertices[0].z = 2.0f;
-	vertices[0].r = 255;	vertices[0].g = 0;		vertices[0].b = 0;
-	vertices[0].u = 0.0f;   vertices[0].v = 0.0f;
-	vertices[0].nx = 0.0f;	vertices[0].ny = 0.0f;	vertices[0].nz = 1.0f;
-
-	vertices[1].x = -3.0f;	vertices[1].y = 3.0f;	vertices[1].z = 2.0f;
-	vertices[1].r = 0;		vertices[1].g = 255;	vertices[1].b = 0;
-	vertices[1].u = 1.0f;   vertices[1].v = 0.0f;
-	vertices[1].nx = 0.0f;	vertices[1].ny = 0.0f;	vertices[1].nz = 1.0f;
-
-	vertices[2].x = -5.0f;	vertices[2].y = 1.0f;	vertices[2].z = 2.0f;
-	vertices[2].r = 0;		vertices[2].g = 0;		vertices[2].b = 255;
-	vertices[2].u = 0.0f;   vertices[2].v = 1.0f;
-	vertices[2].nx = 0.0f;	vertices[2].ny = 0.0f;	vertices[2].nz = 1.0f;
-
-	vertices[3].x = -5.0f;	vertices[3].y = 3.0f;	vertices[3].z = 2.0f;
-	vertices[3].r = 0;		vertices[3].g = 0;		vertices[3].b = 255;
-	vertices[3].u = 1.0f;   vertices[3].v = 1.0f;
-	vertices[3].nx = 0.0f;	vertices[3].ny = 0.0f;	vertices[3].nz = 1.0f;
-
-	//Back Facing Square
-	vertices[4].x = -3.0f;	vertices[4].y = 1.0f;	vertices[4].z = 0.0f;
-	vertices[4].r = 0;		vertices[4].g = 0;		vertices[4].b = 0;
-	vertices[4].u = 0.0f;   vertices[4].v = 0.0f;
-	vertices[4].nx = 0.0f;	vertices[4].ny = 0.0f;	vertices[4].nz = -1.0f;
-
-	vertices[5].x = -3.0f;	vertices[5].y = 3.0f;	vertices[5].z = 0.0f;
-	vertices[5].r = 0;		vertices[5].g = 0;		vertices[5].b = 0;
-	vertices[5].u = 1.0f;   vertices[5].v = 0.0f;
-	vertices[5].nx = 0.0f;	vertices[5].ny = 0.0f;	vertices[5].nz = -1.0f;
-
-	vertices[6].x = -5.0f;	vertices[6].y = 1.0f;	vertices[6].z = 0.0f;
-	vertices[6].r = 0;		vertices[6].g = 0;		vertices[6].b = 255;
-	vertices[6].u = 0.0f;   vertices[6].v = 1.0f;
-	vertices[6].nx = 0.0f;	vertices[6].ny = 0.0f;	vertices[6].nz = -1.0f;
-
-	vertices[7].x = -5.0f;	vertices[7].y = 3.0f;	vertices[7].z = 0.0f;
-	vertices[7].r = 0;		vertices[7].g = 0;		vertices[7].b = 255;
-	vertices[7].u = 1.0f;   vertices[7].v = 1.0f;
-	vertices[7].nx = 0.0f;	vertices[7].ny = 0.0f;	vertices[7].nz = -1.0f;
-
-	//Right Facing Square
-	vertices[8].x = -3.0f;	vertices[8].y = 3.0f;	vertices[8].z = 0.0f;
-	vertices[8].r = 255;	vertices[8].g = 0;		vertices[8].b = 0;
-	vertices[8].u = 0.0f;   vertices[8].v = 0.0f;
-	vertices[8].nx = 1.0f;	vertices[8].ny = 0.0f;	vertices[8].nz = 0.0f;
-
-	vertices[9].x = -3.0f;	vertices[9].y = 1.0f;	vertices[9].z = 0.0f;
-	vertices[9].r = 0;		vertices[9].g = 255;	vertices[9].b = 0;
-	vertices[9].u = 1.0f;   vertices[9].v = 0.0f;
-	vertices[9].nx = 1.0f;	vertices[9].ny = 0.0f;	vertices[9].nz = 0.0f;
-
-	vertices[10].x = -3.0f;	vertices[10].y = 3.0f;	vertices[10].z = 2.0f;
-	vertices[10].r = 255;	vertices[10].g = 0;		vertices[10].b = 0;
-	vertices[10].u = 0.0f;  vertices[10].v = 1.0f;
-	vertices[10].nx = 1.0f;	vertices[10].ny = 0.0f; vertices[10].nz = 0.0f;
-
-	vertices[11].x = -3.0f;	vertices[11].y = 1.0f;	vertices[11].z = 2.0;
-	vertices[11].u = 1.0f;  vertices[11].v = 1.0f;
-	vertices[11].nx = 1.0f;	vertices[11].ny = 0.0f;vertices[11].nz = 0.0f;
-
-	//Top Facing Square
-	vertices[12].x = -3.0f;	vertices[12].y = 3.0f;	vertices[12].z = 0.0f;
-	vertices[12].r = 0;		vertices[12].g = 0;		vertices[12].b = 255;
-	vertices[12].u = 0.0f;  vertices[12].v = 0.0f;
-	vertices[12].nx = 0.0f;	vertices[12].ny = 1.0f; vertices[12].nz = 0.0f;
-
-	vertices[13].x = -3.0f;	vertices[13].y = 3.0f;	vertices[13].z = 2.0f;
-	vertices[13].r = 0;		vertices[13].g = 0;		vertices[13].b = 255;
-	vertices[13].u = 1.0f;   vertices[13].v = 0.0f;
-	vertices[13].nx = 0.0f;	vertices[13].ny = 1.0f; vertices[13].nz = 0.0f;
-
-	vertices[14].x = -5.0f;	vertices[14].y = 3.0f;	vertices[14].z = 0.0f;
-	vertices[14].r = 0;		vertices[14].g = 255;	vertices[14].b = 0;
-	vertices[14].u = 0.0f;   vertices[14].v = 1.0f;
-	vertices[14].nx = 0.0f;	vertices[14].ny = 1.0f; vertices[14].nz = 0.0f;
-
-	vertices[15].x = -5.0f;	vertices[15].y = 3.0f;	vertices[15].z = 2.0f;
-	vertices[15].r = 0;		vertices[15].g = 255;	vertices[15].b = 0;
-	vertices[15].u = 1.0f;   vertices[15].v = 1.0f;
-	vertices[15].nx = 0.0f;	vertices[15].ny = 1.0f; vertices[15].nz = 0.0f;
-
-	//Left Facing Square
-	vertices[16].x = -5.0f;	vertices[16].y = 1.0f;	vertices[16].z = 2.0f;
-	vertices[16].r = 0;		vertices[16].g = 0;		vertices[16].b = 255;
-	vertices[16].u = 0.0f;   vertices[16].v = 0.0f;
-	vertices[16].nx = -1.0f;	vertices[16].ny = 0.0f; vertices[16].nz = 0.0f;
-
-	vertices[17].x = -5.0f;	vertices[17].y = 3.0f;	vertices[17].z = 2.0f;
-	vertices[17].r = 0;		vertices[17].g = 0;		vertices[17].b = 255;
-	vertices[17].u = 1.0f;   vertices[17].v = 0.0f;
-	vertices[17].nx = -1.0f;	vertices[17].ny = 0.0f; vertices[17].nz = 0.0f;
-
-	vertices[18].x = -5.0f;	vertices[18].y = 1.0f;	vertices[18].z = 0.0f;
-	vertices[18].r = 0;		vertices[18].g = 0;		vertices[18].b = 255;
-	vertices[18].u = 0.0f;   vertices[18].v = 1.0f;
-	vertices[18].nx = -1.0f;	vertices[18].ny = 0.0f; vertices[18].nz = 0.0f;
-
-	vertices[19].x = -5.0f;	vertices[19].y = 3.0f;	vertices[19].z = 0.0f;
-	vertices[19].r = 0;		vertices[19].g = 0;		vertices[19].b = 255;
-	vertices[19].u = 1.0f;   vertices[19].v = 1.0f;
-	vertices[19].nx = -1.0f;	vertices[19].ny = 0.0f; vertices[19].nz = 0.0f;
-
-	//Bottom Facing Square
-	vertices[20].x = -3.0f;	vertices[20].y = 1.0f;	vertices[20].z = 2.0f;
-	vertices[20].r = 0;		vertices[20].g = 0;		vertices[20].b = 0;
-	vertices[20].u = 0.0f;   vertices[20].v = 0.0f;
-	vertices[20].nx = 0.0f;	vertices[20].ny = -1.0f;	vertices[20].nz = 0.0f;
-
-	vertices[21].x = -3.0f;	vertices[21].y = 1.0f;	vertices[21].z = 0.0f;
-	vertices[21].r = 0;		vertices[21].g = 0;		vertices[21].b = 0;
-	vertices[21].u = 1.0f;   vertices[21].v = 0.0f;
-	vertices[21].nx = 0.0f;	vertices[21].ny = -1.0f;	vertices[21].nz = 0.0f;
-
-	vertices[22].x = -5.0f;	vertices[22].y = 1.0f;	vertices[22].z = 2.0f;
-	vertices[22].r = 0;		vertices[22].g = 0;		vertices[22].b = 255;
-	vertices[22].u = 0.0f;   vertices[22].v = 1.0f;
-	vertices[22].nx = 0.0f;	vertices[22].ny = -1.0f;	vertices[22].nz = 0.0f;
-
-	vertices[23].x = -5.0f;	vertices[23].y = 1.0f;	vertices[23].z = 0.0f;
-	vertices[23].r = 0;		vertices[23].g = 0;		vertices[23].b = 255;
-	vertices[23].u = 1.0f;   vertices[23].v = 1.0f;
-	vertices[23].nx = 0.0f;	vertices[23].ny = -1.0f;	vertices[23].nz = 0.0f;
-
-	//Back Panel
-	vertices[24].x = 10.0f;	vertices[24].y = 1.0f;	vertices[24].z = -5.0f;
-	vertices[24].r = 0;		vertices[24].g = 0;		vertices[24].b = 0;
-	vertices[24].u = 0.0f;   vertices[24].v = 0.0f;
-	vertices[24].nx = 0.0f;	vertices[24].ny = 0.0f;	vertices[24].nz = 1.0f;
-
-	vertices[25].x = 10.0f;	vertices[25].y = 15.0f;	vertices[25].z = -5.0f;
-	vertices[25].r = 0;		vertices[25].g = 0;		vertices[25].b = 0;
-	vertices[25].u = 1.0f;   vertices[25].v = 0.0f;
-	vertices[25].nx = 0.0f;	vertices[25].ny = 0.0f;	vertices[25].nz = 1.0f;
-
-	vertices[26].x = -11.0f;	vertices[26].y = 1.0f;	vertices[26].z = -5.0f;
-	vertices[26].r = 0;		vertices[26].g = 0;		vertices[26].b = 255;
-	vertices[26].u = 0.0f;   vertices[26].v = 1.0f;
-	vertices[26].nx = 0.0f;	vertices[26].ny = 0.0f;	vertices[26].nz = 1.0f;
-
-	vertices[27].x = -11.0f;	vertices[27].y = 15.0f;	vertices[27].z = -5.0f;
-	vertices[27].r = 0;		vertices[27].g = 0;		vertices[27].b = 255;
-	vertices[27].u = 1.0f;   vertices[27].v = 1.0f;
-	vertices[27].nx = 0.0f;	vertices[27].ny = 0.0f;	vertices[27].nz = 1.0f;
-
-	//Left Side Panel
-	vertices[28].x = -11.0f;	vertices[28].y = 15.0f;	vertices[28].z = -5.0f;
-	vertices[28].r = 242;		vertices[28].g = 172;		vertices[28].b = 164;
-	vertices[28].u = 0.0f;   vertices[28].v = 0.0f;
-	vertices[28].nx = 1.0f;	vertices[28].ny = 0.0f;	vertices[28].nz = 0.0f;
-
-	vertices[29].x = -11.0f;	vertices[29].y = 1.0f;	vertices[29].z = -5.0f;
-	vertices[29].r = 242;		vertices[29].g = 172;		vertices[29].b = 164;
-	vertices[29].u = 1.0f;   vertices[29].v = 0.0f;
-	vertices[29].nx = 1.0f;	vertices[29].ny = 0.0f;	vertices[29].nz = 0.0f;
-
-	vertices[30].x = -11.0f;	vertices[30].y = 15.0f;	vertices[30].z = 7.0f;
-	vertices[30].r = 242;		vertices[30].g = 172;		vertices[30].b = 164;
-	vertices[30].u = 0.0f;   vertices[30].v = 1.0f;
-	vertices[30].nx = 1.0f;	vertices[30].ny = 0.0f;	vertices[30].nz = 0.0f;
-
-	vertices[31].x = -11.0f;	vertices[31].y = 1.0f;	vertices[31].z = 7.0f;
-	vertices[31].r = 242;		vertices[31].g = 172;		vertices[31].b = 164;
-	vertices[31].u = 1.0f;   vertices[31].v = 1.0f;
-	vertices[31].nx = 1.0f;	vertices[31].ny = 0.0f;	vertices[31].nz = 0.0f;
-
-	//Right Side Panel
-
-	vertices[32].x = 10.0f;	vertices[32].y = 15.0f;	vertices[32].z = -5.0f;
-	vertices[32].r = 242;		vertices[32].g = 172;		vertices[32].b = 164;
-	vertices[32].u = 0.0f;   vertices[32].v = 0.0f;
-	vertices[32].nx = -1.0f;	vertices[32].ny = 0.0f;	vertices[32].nz = 0.0f;
-
-	vertices[33].x = 10.0f;	vertices[33].y = 1.0f;	vertices[33].z = -5.0f;
-	vertices[33].r = 242;		vertices[33].g = 172;		vertices[33].b = 164;
-	vertices[33].u = 1.0f;   vertices[33].v = 0.0f;
-	vertices[33].nx = -1.0f;	vertices[33].ny = 0.0f;	vertices[33].nz = 0.0f;
-
-	vertices[34].x = 10.0f;	vertices[34].y = 15.0f;	vertices[34].z = 7.0f;
-	vertices[34].r = 242;		vertices[34].g = 172;		vertices[34].b = 164;
-	vertices[34].u = 0.0f;   vertices[34].v = 1.0f;
-	vertices[34].nx = -1.0f;	vertices[34].ny = 0.0f;	vertices[34].nz = 0.0f;
-
-	vertices[35].x = 10.0f;	vertices[35].y = 1.0f;	vertices[35].z = 7.0f;
-	vertices[35].r = 242;		vertices[35].g = 172;		vertices[35].b = 164;
-	vertices[35].u = 1.0f;   vertices[35].v = 1.0f;
-	vertices[35].nx = -1.0f;	vertices[35].ny = 0.0f;	vertices[35].nz = 0.0f;
-
-	//Floor Panel
-
-	vertices[36].x = 10.0f;	vertices[36].y = 1.0f;	vertices[36].z = -5.0f;
-	vertices[36].r = 0;		vertices[36].g = 0;		vertices[36].b = 255;
-	vertices[36].u = 0.0f;   vertices[36].v = 0.0f;
-	vertices[36].nx = 0.0f;	vertices[36].ny = 1.0f;	vertices[36].nz = 0.0f;
-
-	vertices[37].x = 10.0f;	vertices[37].y = 1.0f;	vertices[37].z = 7.0f;
-	vertices[37].r = 0;		vertices[37].g = 0;		vertices[37].b = 255;
-	vertices[37].u = 1.0f;   vertices[37].v = 0.0f;
-	vertices[37].nx = 0.0f;	vertices[37].ny = 1.0f;	vertices[37].nz = 0.0f;
-
-	vertices[38].x = -11.0f;	vertices[38].y = 1.0f;	vertices[38].z = -5.0f;
-	vertices[38].r = 0;		vertices[38].g = 0;		vertices[38].b = 255;
-	vertices[38].u = 0.0f;   vertices[38].v = 1.0f;
-	vertices[38].nx = 0.0f;	vertices[38].ny = 1.0f;	vertices[38].nz = 0.0f;
-
-	vertices[39].x = -11.0f;	vertices[39].y = 1.0f;	vertices[39].z = 7.0f;
-	vertices[39].r = 0;		vertices[39].g = 0;		vertices[39].b = 255;
-	vertices[39].u = 1.0f;   vertices[39].v = 1.0f;
-	vertices[39].nx = 0.0f;	vertices[39].ny = 1.0f;	vertices[39].nz = 0.0f;
-
-	GLuint vbo;
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	// Create a vertex array object that contains data on how to map vertex attributes
-	// (e.g., position, color) to vertex shader properties.
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	// The vertex and index blobs go straight from the mapped file to the GPU, or through
+	// packing with --packed-vertices and splitting with --split-streams
+	Mesh sceneMesh = CreateMesh(scene.vertices, scene.vertexCount, scene.indices, scene.indexCount, options.vertexLayout, options.vertexStreams);
 
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	// Linked programs are cached next to the executable, so warm starts skip the shader compiler
+	ProgramCache programCache;
+	if (!InitProgramCache(programCache, "."))
+	{
+		std::cerr << "Program binaries not supported, shaders are compiled on every launch" << std::endl;
+	}
+
+	// Shader files are watched and rebuilt when they change, except when the frames
+	// have to be reproducible
+	ShaderLibrary shaders;
+	InitShaderLibrary(shaders, programCache, !options.bench && options.replayPath.empty());
+
+	// Create a shader program. The deferred renderer draws the same geometry, but into the G-buffer.
+	bool deferred = options.renderer == RENDERER_DEFERRED;
+	const char* surfaceShader = deferred ? "gbuffer.fsh" : "main.fsh";
+
+	// Every object is drawn with the variant of the surface shader its material needs. The G-buffer
+	// keeps the specular choice, but the deferred lights reach every pixel, so point lights are no feature there.
+	uint32_t surfaceFeatureMask = deferred ? (SHADER_FEATURE_TEXTURED | SHADER_FEATURE_SPECULAR) : SHADER_FEATURE_ALL;
+	uint32_t vertexFeatures = options.vertexLayout == VERTEX_LAYOUT_PACKED ? static_cast<uint32_t>(SHADER_FEATURE_PACKED_VERTICES) : 0u;
+	ShaderVariants shaderVariants;
+	std::vector<int> objectProgramIndices(scene.objectCount);
+	for (size_t i = 0; i < scene.objectCount; i++)
+	{
+		uint32_t features = (GetObjectShaderFeatures(scene.objects[i].flags) & surfaceFeatureMask) | vertexFeatures;
+		objectProgramIndices[i] = GetShaderVariant(shaderVariants, shaders, "main.vsh", surfaceShader, features);
+	}
 
-	// Vertex attribute 0 - Position
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	// With --depth-prepass, every opaque object is drawn a first time with positions only
+	int depthProgramIndex = options.depthPrepass ? GetShaderVariant(shaderVariants, shaders, "depth.vsh", "depth.fsh", vertexFeatures) : -1;
+	UniformBuffers uniformBuffers = CreateUniformBuffers(static_cast<GLsizeiptr>(scene.objectCount));
+
+	// World and normal matrices are only recomputed for the nodes that moved, the per-object
+	// blocks only when the camera or a node did
+	SceneGraph sceneGraph = BuildSceneGraph(scene);
+
+	// Objects with detail levels draw the one matching their size on screen. Their bounds
+	// cover every level, so culling does not depend on the level drawn.
+	LodLibrary lodLibrary;
+	InitLodLibrary(lodLibrary, scene, sceneMesh, options.vertexLayout, options.vertexStreams);
+	ExtendSceneBoundsToLods(sceneGraph, lodLibrary);
+
+	TransformBatch objectTransforms;
+	ResizeTransformBatch(objectTransforms, scene.objectCount);
+	UpdateSceneGraph(sceneGraph, objectTransforms);
+
+	// Only the objects whose world bounds intersect the view frustum are submitted
+	Bvh sceneBvh;
+	BuildBvh(sceneBvh, sceneGraph.objectBounds);
+	std::vector<int> visibleObjects;
+	CullingStats cullingStats;
+
+	// With --occlusion-culling, objects hidden behind others are skipped by the GPU from the next frame on
+	OcclusionCuller occlusionCuller;
+	int occlusionProgramIndex = -1;
+	std::vector<int> submittedObjects;
+	if (options.occlusionCulling)
+	{
+		occlusionCuller = CreateOcclusionCuller(scene.objectCount);
+		occlusionProgramIndex = AddShaderProgram(shaders, "occlusion_box.vsh", "occlusion_box.fsh");
+	}
 
-	// Vertex attribute 1 - Color
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)(sizeof(GLfloat) * 3));
+	// --- Instanced torii gates ---
 
-	// Vertex attribute 2 - UV coordinate
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, u)));
+	// The parts of the scene's first gate, which stands at the origin, drawn once per gate by
+	// the instanced path. Scenes with more gates, like the forest, store the others after it.
+	std::vector<ToriiGatePart> gateParts;
+	MeshRange gatePartRange;
+	uint32_t gateFeatures = 0;		// Every feature any part needs, since the parts share one draw
+	for (size_t i = 0; i < scene.objectCount && gateParts.size() < static_cast<size_t>(TORII_GATE_PART_COUNT); i++)
+	{
+		if (scene.objects[i].flags & SCENE_OBJECT_GATE_PART)
+		{
+			ToriiGatePart part;
+			part.model = scene.objects[i].model;
+			part.texIndex = static_cast<GLint>(scene.objects[i].textureIndex);
+			if (gateParts.empty())
+			{
+				gatePartRange = GetObjectRange(scene.objects[i]);
+			}
+			gateParts.push_back(part);
+			gateFeatures |= GetObjectShaderFeatures(scene.objects[i].flags);
+		}
+	}
 
-	// Vertex attribute 3 - Normal Vertex
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, nx)));
+	// The gates never move, so their instance data is uploaded once
+	std::vector<InstanceData> gateInstances = BuildGateInstances(GetGateGridTransforms(options.gateCount, 16.0f, 12.0f), gateParts);
+	GLuint instanceVbo;
+	glGenBuffers(1, &instanceVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+	glBufferData(GL_ARRAY_BUFFER, gateInstances.size() * sizeof(InstanceData), gateInstances.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glBindVertexArray(0);
+	GLuint instancedVao = CreateInstancedVertexArray(sceneMesh, instanceVbo);
 
-	// Create a shader program
-	GLuint program = CreateShaderProgram("main.vsh", "main.fsh");
+	int instancedProgramIndex = GetShaderVariant(shaderVariants, shaders, "instanced.vsh", surfaceShader, (gateFeatures & surfaceFeatureMask) | vertexFeatures);
 
 	//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -407,482 +350,404 @@ int main()
 	// For now, tell OpenGL to use the whole screen
 	glViewport(0, 0, windowWidth, windowHeight);
 
-	// Create a variable that will contain the ID for our texture,
-	// and use glGenTextures() to generate the texture itself
-	GLuint tex[5];
-	glGenTextures(5, tex);
-
-	// --- Load our image using stb_image ---
-
-	stbi_set_flip_vertically_on_load(true);
-
-	int imageWidth, imageHeight, numChannels;
-
-
-	unsigned char* imageData;
-
-
-	glBindTexture(GL_TEXTURE_2D, tex[0]);
-	imageData = stbi_load("toriigate_redwood.jpg", &imageWidth, &imageHeight, &numChannels, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-	stbi_image_free(imageData);
-
-	glBindTexture(GL_TEXTURE_2D, tex[1]);
-	imageData = stbi_load("toriigate_base2.jpg", &imageWidth, &imageHeight, &numChannels, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-	stbi_image_free(imageData);
-
-	glBindTexture(GL_TEXTURE_2D, tex[2]);
-	imageData = stbi_load("backpanel.jpg", &imageWidth, &imageHeight, &numChannels, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-	stbi_image_free(imageData);
-
-	glBindTexture(GL_TEXTURE_2D, tex[3]);
-	imageData = stbi_load("floor.jpg", &imageWidth, &imageHeight, &numChannels, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-	stbi_image_free(imageData);
-	
-	glBindTexture(GL_TEXTURE_2D, tex[4]);
-	imageData = stbi_load("sidepanel.jpg", &imageWidth, &imageHeight, &numChannels, 0);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, imageWidth, imageHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-	stbi_image_free(imageData);
-
-	glEnable(GL_DEPTH_TEST);
-
-	// Render loop
-	while (!glfwWindowShouldClose(window))
-	{
-		float currentFrame = static_cast<float>(glfwGetTime());
-		deltaTime = currentFrame - lastFrame;
-
-		lightPos.x = 0;
-		lightPos.y = sin(glfwGetTime()) * 20.0f;
-		lightPos.z = cos(glfwGetTime()) * 20.0f;
-
-		processInput(window);
-
-		// Clear the colors in our off-screen framebuffer
-		glClear(GL_COLOR_BUFFER_BIT);
-		glClear(GL_DEPTH_BUFFER_BIT);
-
-		//Transformation "Globals"
-		glm::mat4 PerspectiveProj = glm::perspective(glm::radians(fov), 800.0f / 600.0f, 0.1f, 100.0f);
-		glm::mat4 camera = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-		GLint uniformLocation = glGetUniformLocation(program, "mvp");
-		GLint texUniformLocation = glGetUniformLocation(program, "texture_redwood");
-		GLint ambientUniformLocation = glGetUniformLocation(program, "ambient");
-		GLint diffuseUniformLocation = glGetUniformLocation(program, "diffuse");
-		GLint specularUniformLocation = glGetUniformLocation(program, "specular");
-		GLint lightUniformLocation = glGetUniformLocation(program, "lightPos");
-		GLint modelUniformLocation = glGetUniformLocation(program, "model");
-		GLint normalUniformLocation = glGetUniformLocation(program, "norm");
-		GLint viewUniformLocation = glGetUniformLocation(program, "cameraPos");
-		GLint specCompUniformLocation = glGetUniformLocation(program, "specComp");
-		glUniform3f(lightUniformLocation, lightPos.x, lightPos.y, lightPos.z);
-		glUniform3f(ambientUniformLocation, ambient.x, ambient.y, ambient.z);
-		glUniform3f(diffuseUniformLocation, diffuse.x, diffuse.y, diffuse.z);
-		glUniform3f(specularUniformLocation, specular.x, specular.y, specular.z);
-		glUniform3f(viewUniformLocation, cameraPos.x, cameraPos.y, cameraPos.z);
-		glUniform3f(specCompUniformLocation, specComp.x, specComp.y, specComp.z);
-		//Spotlight Candle
-		GLint ambientSpotUniformLocation = glGetUniformLocation(program, "ambientSpot");
-		GLint diffuseSpotUniformLocation = glGetUniformLocation(program, "diffuseSpot");
-		GLint specularSpotUniformLocation = glGetUniformLocation(program, "specularSpot");
-		GLint lightSpotUniformLocation = glGetUniformLocation(program, "lightPosSpot");
-		GLint specCompSpotUniformLocation = glGetUniformLocation(program, "specCompSpot");
-		GLint constantSpotUniformLocation = glGetUniformLocation(program, "constantSpot");
-		GLint linearSpotUniformLocation = glGetUniformLocation(program, "linearSpot");
-		GLint quadraticSpotUniformLocation = glGetUniformLocation(program, "quadraticSpot");
-		glUniform3f(lightSpotUniformLocation, lightPosSpot.x, lightPosSpot.y, lightPosSpot.z);
-		glUniform3f(ambientSpotUniformLocation, ambientSpot.x, ambientSpot.y, ambientSpot.z);
-		glUniform3f(diffuseSpotUniformLocation, diffuseSpot.x, diffuseSpot.y, diffuseSpot.z);
-		glUniform3f(specularSpotUniformLocation, specularSpot.x, specularSpot.y, specularSpot.z);
-		glUniform3f(specCompSpotUniformLocation, specCompSpot.x, specCompSpot.y, specCompSpot.z);
-		glUniform1f(constantSpotUniformLocation, constantSpot);
-		glUniform1f(linearSpotUniformLocation, linearSpot);
-		glUniform1f(quadraticSpotUniformLocation, quadraticSpot);
-
-		//Left Torii Base
-		//Transformations
-		glm::mat4 LTB = glm::mat4(1.0f);
-		glm::mat3 normalLTB = glm::transpose(glm::inverse(glm::mat3(LTB)));
-		glm::mat4 modelLTB = LTB;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelLTB));
-		LTB = PerspectiveProj * camera * LTB;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(LTB));
-
-		// Use the shader program that we created
-		glUseProgram(program);
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[1]);
-
-		glUniform1i(texUniformLocation, 0);
-		
-		// Draw the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
-
-		//Left Torii Pillar
-		//Transformations
-		glm::mat4 LTP = glm::mat4(1.0f);
-		LTP = glm::translate(LTP, glm::vec3(-1.0f, -3.5f, 0.125f));
-		LTP = glm::scale(LTP, glm::vec3(0.75f, 6.0f, 0.75f));
-		glm::mat3 normalLTP = glm::transpose(glm::inverse(glm::mat3(LTP)));
-		glm::mat4 modelLTP = LTP;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelLTP));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalLTP));
-		LTP = PerspectiveProj * camera * LTP;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(LTP));
-
-		// Use the shader program that we created
-		glUseProgram(program);
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[0]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
-
-		//Right Torii Base
-		//Transformations
-		glm::mat4 RTB = glm::mat4(1.0f);
-		RTB = glm::translate(RTB, glm::vec3(6.0f, 0.0f, 0.0f));
-		glm::mat3 normalRTB = glm::transpose(glm::inverse(glm::mat3(RTB)));
-		glm::mat4 modelRTB = RTB;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelRTB));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalRTB));
-		RTB = PerspectiveProj * camera * RTB;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(RTB));
-
-		// Use the shader program that we created
-		glUseProgram(program);
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[1]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
-
-		//Right Torii Pillar
-		//Transformations
-		glm::mat4 RTP = glm::mat4(1.0f);
-		RTP = glm::translate(RTP, glm::vec3(-1.0f, -3.5f, 0.125f));
-		RTP = glm::scale(RTP, glm::vec3(0.75f, 6.0f, 0.75f));
-		RTP = glm::translate(RTP, glm::vec3(8.0f, 0.0f, 0.0f));
-		glm::mat3 normalRTP = glm::transpose(glm::inverse(glm::mat3(RTP)));
-		glm::mat4 modelRTP = RTP;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelRTP));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalRTP));
-		RTP = PerspectiveProj * camera * RTP;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(RTP));
-
-		// Use the shader program that we created
-		glUseProgram(program);
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[0]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
-
-		//Middle Horizontal Pillar
-		glm::mat4 MHP = glm::mat4(1.0f);
-		MHP = glm::translate(MHP, glm::vec3(11.0f, 12.5f, 0.135f));
-		MHP = glm::rotate(MHP, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		MHP = glm::scale(MHP, glm::vec3(0.3f, 6.0f, 0.7f));
-		glm::mat3 normalMHP = glm::transpose(glm::inverse(glm::mat3(MHP)));
-		glm::mat4 modelMHP = MHP;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelMHP));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalMHP));
-		MHP = PerspectiveProj * camera * MHP;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(MHP));
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[0]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		glBindVertexArray(0);
-
-		//Middle Top Pillar
-		glm::mat4 MTP = glm::mat4(1.0f);
-		MTP = glm::translate(MTP, glm::vec3(11.0f, 15.999f, 0.135f));
-		MTP = glm::rotate(MTP, glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		MTP = glm::scale(MTP, glm::vec3(0.3f, 6.0f, 0.7f));
-		glm::mat3 normalMTP = glm::transpose(glm::inverse(glm::mat3(MTP)));
-		glm::mat4 modelMTP = MTP;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelMTP));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalMTP));
-		MTP = PerspectiveProj * camera * MTP;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(MTP));
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[0]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		glBindVertexArray(0);
-
-		//Left Roof Wing
-		glm::mat4 LRW = glm::mat4(1.0f);
-		LRW = glm::translate(LRW, glm::vec3(-5.65f, 15.699f, 0.136f));
-		LRW = glm::rotate(LRW, glm::radians(75.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		LRW = glm::scale(LRW, glm::vec3(0.3f, 1.0f, 0.69f));
-		glm::mat3 normalLRW = glm::transpose(glm::inverse(glm::mat3(LRW)));
-		glm::mat4 modelLRW = LRW;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelLRW));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalLRW));
-		LRW = PerspectiveProj * camera * LRW;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(LRW));
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[0]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		glBindVertexArray(0);
-
-		//Right Roof Wing
-		glm::mat4 RRW = glm::mat4(1.0f);
-		RRW = glm::translate(RRW, glm::vec3(7.52f, 16.735f, 0.135f));
-		RRW = glm::rotate(RRW, glm::radians(105.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-		RRW = glm::scale(RRW, glm::vec3(0.3f, 1.0f, 0.69f));
-
-		RRW = PerspectiveProj * camera * RRW;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(RRW));
-		glm::mat3 normalRRW = glm::transpose(glm::inverse(glm::mat3(RRW)));
-		glm::mat4 modelRRW = RRW;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelRRW));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalRRW));
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[0]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-		glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-
-		glBindVertexArray(0);
-
-		//Back Panel
-		glm::mat4 BackPanel = glm::mat4(1.0f);
-		glm::mat3 normalBackPanel = glm::transpose(glm::inverse(glm::mat3(BackPanel)));
-		glm::mat4 modelBackPanel = BackPanel;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelBackPanel));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalBackPanel));
-		BackPanel = PerspectiveProj * camera * BackPanel;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(BackPanel));
-
-		// Use the shader program that we created
-		glUseProgram(program);
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[2]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 24, 4);
-		
-
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
+	// Every scene texture is one layer of a single texture array, so objects never
+	// need to switch textures
+	MaterialArray materials = CreateMaterialArray(static_cast<int>(scene.textureCount), options.materialSize, options.compressTextures);
 
-		//Left Panel
-		glm::mat4 LeftPanel = glm::mat4(1.0f);
-		glm::mat3 normalLeftPanel = glm::transpose(glm::inverse(glm::mat3(LeftPanel)));
-		glm::mat4 modelLeftPanel = LeftPanel;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelLeftPanel));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalLeftPanel));
-		LeftPanel = PerspectiveProj * camera * LeftPanel;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(LeftPanel));
+	// Point lights are shaded per cluster of the view frustum, so only the few lights
+	// reaching a fragment cost anything
+	ClusterGrid clusterGrid = CreateClusterGrid(0.1f, 100.0f);
 
-		// Use the shader program that we created
-		glUseProgram(program);
-
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[4]);
-
-		glUniform1i(texUniformLocation, 0);
-
-		// Draw the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 28, 4);
-		
-
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
-
-		//Right Panel
-		glm::mat4 RightPanel = glm::mat4(1.0f);
-		glm::mat3 normalRightPanel = glm::transpose(glm::inverse(glm::mat3(RightPanel)));
-		glm::mat4 modelRightPanel = RightPanel;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelRightPanel));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalRightPanel));
-		RightPanel = PerspectiveProj * camera * RightPanel;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(RightPanel));
+	// With --renderer deferred, the lights are instead applied afterwards to a G-buffer
+	DeferredRenderer deferredRenderer;
+	int globalLightProgramIndex = -1;
+	int pointLightProgramIndex = -1;
+	if (deferred)
+	{
+		int gbufferWidth = options.benchWidth, gbufferHeight = options.benchHeight;
+		if (!options.bench)
+		{
+			glfwGetFramebufferSize(window, &gbufferWidth, &gbufferHeight);
+		}
+		if (!CreateDeferredRenderer(gbufferWidth, gbufferHeight, deferredRenderer))
+		{
+			std::cerr << "Failed to create the G-buffer!" << std::endl;
+			glfwTerminate();
+			return 1;
+		}
+		// Specular is weighted per pixel by the G-buffer instead
+		std::string lightingDefines = GetShaderFeatureDefines(SHADER_FEATURE_SPECULAR);
+		globalLightProgramIndex = AddShaderProgram(shaders, "fullscreen.vsh", "deferred_global.fsh", lightingDefines);
+		pointLightProgramIndex = AddShaderProgram(shaders, "light_volume.vsh", "light_volume.fsh", lightingDefines);
+	}
 
-		// Use the shader program that we created
-		glUseProgram(program);
+	// From here on, the render loop changes state through the state cache, which skips
+	// calls that would not change anything. The setup above bound things directly, so
+	// start from an unknown state.
+	GLStateCache glState;
+	InvalidateGLState(glState);
+	BindTexture(glState, MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, materials.texture);
+
+	// Draws of the frame, sorted by state and depth before they are issued
+	RenderQueue renderQueue;
+
+	// GPU timer scopes, read back a few frames later so they never stall.
+	// The benchmark always times, and keeps every frame in the statistics.
+	GpuTimers gpuTimers;
+	gpuTimers.enabled = options.gpuTimers || options.bench;
+	if (options.bench)
+	{
+		gpuTimers.historySize = static_cast<size_t>(options.benchFrames);
+	}
+	int frameScope = AddGpuTimerScope(gpuTimers, "frame");
+	int clearScope = AddGpuTimerScope(gpuTimers, "clear");
+	int gatesScope = AddGpuTimerScope(gpuTimers, "instanced gates");
+	int depthPrepassScope = options.depthPrepass ? AddGpuTimerScope(gpuTimers, "depth prepass") : -1;
+	int objectsScope = AddGpuTimerScope(gpuTimers, "objects");
+	int occlusionScope = options.occlusionCulling ? AddGpuTimerScope(gpuTimers, "occlusion queries") : -1;
+	int lightingScope = deferred ? AddGpuTimerScope(gpuTimers, "deferred lighting") : -1;
+
+	// --- Load our images in the background ---
+
+	// Every layer starts as a placeholder, so the first frame does not wait for any decode.
+	// The images are decoded on worker threads and uploaded by the render loop as they finish.
+	std::vector<std::string> texturePaths;
+	for (size_t i = 0; i < scene.textureCount; i++)
+	{
+		texturePaths.push_back(scene.textures[i].path);
+	}
+	TextureLoader textureLoader;
+	StartTextureLoads(textureLoader, texturePaths, materials);
 
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
+	// Lights of the scene. The global light orbits the scene, see the render loop.
+	// Every point light of the scene, the candle among them, goes to the cluster grid.
+	SceneLightRecord globalLight = {};
+	if (const SceneLightRecord* light = FindSceneLight(scene, SCENE_LIGHT_GLOBAL))
+	{
+		globalLight = *light;
+		lightPos = globalLight.position;
+	}
+	std::vector<PointLight> pointLights = GenerateLanternLights(options.lightCount, 25.0f);
+	for (size_t i = 0; i < scene.lightCount; i++)
+	{
+		if (scene.lights[i].type == SCENE_LIGHT_POINT)
+		{
+			pointLights.push_back(MakePointLight(scene.lights[i]));
+		}
+	}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[4]);
+	SetCapability(glState, GL_DEPTH_TEST, true);
 
-		glUniform1i(texUniformLocation, 0);
+	// --- Benchmark setup ---
 
-		// Draw the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 32, 4);
-		
+	BenchTarget benchTarget;
+	std::vector<float> benchCpuFrameTimes;
+	if (options.bench)
+	{
+		if (!CreateBenchTarget(options.benchWidth, options.benchHeight, benchTarget))
+		{
+			std::cerr << "Failed to create the benchmark framebuffer!" << std::endl;
+			glfwTerminate();
+			return 1;
+		}
+		glViewport(0, 0, benchTarget.width, benchTarget.height);
+
+		// Every frame should measure the same work, so wait for all textures first
+		while (UploadFinishedTextures(textureLoader, glState, SIZE_MAX))
+		{
+			std::this_thread::yield();
+		}
+		benchCpuFrameTimes.reserve(options.benchFrames);
+	}
+	// --- Input recording and replay ---
 
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
+	InputFrame inputFrame;
+	if (!options.bench && !options.replayPath.empty())
+	{
+		if (!OpenInputReplay(inputReplay, options.replayPath))
+		{
+			glfwTerminate();
+			return 1;
+		}
+
+		// Replays measure the recorded session, not how fast textures stream in
+		while (UploadFinishedTextures(textureLoader, glState, SIZE_MAX))
+		{
+			std::this_thread::yield();
+		}
+	}
 
-		//Floor Panel
-		glm::mat4 FloorPanel = glm::mat4(1.0f);
-		glm::mat3 normalFloorPanel = glm::transpose(glm::inverse(glm::mat3(FloorPanel)));
-		glm::mat4 modelFloorPanel = FloorPanel;
-		glUniformMatrix4fv(modelUniformLocation, 1, GL_FALSE, glm::value_ptr(modelFloorPanel));
-		glUniformMatrix3fv(normalUniformLocation, 1 , GL_TRUE, glm::value_ptr(normalFloorPanel));
-		FloorPanel = PerspectiveProj * camera * FloorPanel;
-    	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(FloorPanel));
+	float aspectRatio = options.bench ? static_cast<float>(benchTarget.width) / benchTarget.height : static_cast<float>(windowWidth) / windowHeight;
+	int frameIndex = 0;
+	double benchStartTime = glfwGetTime();
 
-		// Use the shader program that we created
-		glUseProgram(program);
+	// State call counters of the last frame are shown in the window title once per second,
+	// along with the GPU timer report when enabled
+	double lastStatsTime = glfwGetTime();
 
-		// Use the vertex array object that we created
-		glBindVertexArray(vao);
+	lastFrame = static_cast<float>(inputReplay.active ? inputReplay.startTime : glfwGetTime());
+	if (!options.bench && !inputReplay.active && !options.recordPath.empty())
+	{
+		StartInputRecording(inputRecorder, options.recordPath, lastFrame);
+	}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex[3]);
+	// Render loop
+	while (options.bench ? frameIndex < options.benchFrames : !glfwWindowShouldClose(window))
+	{
+		float currentFrame = static_cast<float>(glfwGetTime());
 
-		glUniform1i(texUniformLocation, 0);
+		// Frame clock driving the camera and the animation. The benchmark advances a fixed
+		// 1/60 s per frame, a replay uses the recorded clock, a live session the real one.
+		float frameClock = currentFrame;
+		uint32_t keys = 0;
+		if (options.bench)
+		{
+			frameClock = frameIndex / 60.0f;
+		}
+		else if (inputReplay.active)
+		{
+			if (!ReadInputFrame(inputReplay, inputFrame))
+			{
+				break;
+			}
+			frameClock = static_cast<float>(inputFrame.time);
+			keys = inputFrame.keys;
+
+			// Apply the events received before this frame, in the order they arrived
+			for (const InputEvent& event : inputFrame.events)
+			{
+				if (event.type == INPUT_EVENT_CURSOR)
+				{
+					ApplyCursorInput(event.x, event.y);
+				}
+				else if (event.type == INPUT_EVENT_SCROLL)
+				{
+					ApplyScrollInput(event.y);
+				}
+			}
+		}
+		else
+		{
+			keys = GetInputKeyMask(window);
+			RecordInputFrame(inputRecorder, currentFrame, keys);
+		}
+		deltaTime = frameClock - lastFrame;
+		lastFrame = frameClock;
+		float animationTime = frameClock;
+
+		BeginStateFrame(glState);
+		BeginGpuTimerFrame(gpuTimers);
+		if (!options.bench && currentFrame - lastStatsTime >= 1.0)
+		{
+			std::string title = "Yae - " + std::to_string(glState.lastFrame.issued) + " state calls, " +
+				std::to_string(glState.lastFrame.skipped) + " skipped per frame, " +
+				std::to_string(clusterGrid.lightCount) + " point lights, up to " + std::to_string(clusterGrid.maxClusterLights) + " per cluster, " +
+				std::to_string(cullingStats.culled) + " of " + std::to_string(cullingStats.objects) + " objects culled in " + std::to_string(cullingStats.boundsTests) + " tests";
+			if (options.occlusionCulling)
+			{
+				ReadOcclusionResults(occlusionCuller);
+				title += ", " + std::to_string(occlusionCuller.occluded) + " of " + std::to_string(occlusionCuller.tested) + " occluded";
+			}
+			glfwSetWindowTitle(window, title.c_str());
+			if (gpuTimers.enabled)
+			{
+				PrintGpuTimerReport(gpuTimers);
+			}
+			lastStatsTime = currentFrame;
+		}
 
-		// Draw the vertices
-		glDrawArrays(GL_TRIANGLE_STRIP, 36, 4);
-		
+		lightPos.x = 0;
+		lightPos.y = sin(animationTime) * 20.0f;
+		lightPos.z = cos(animationTime) * 20.0f;
+
+		if (options.bench)
+		{
+			cameraPos = GetBenchCameraPosition(frameIndex, options.benchFrames);
+			cameraFront = glm::normalize(GetBenchCameraTarget() - cameraPos);
+		}
+		else
+		{
+			processInput(window, keys);
+		}
+
+		// Swap in the textures whose images finished decoding, a few megabytes per frame at most
+		UploadFinishedTextures(textureLoader, glState, 8 * 1024 * 1024);
+
+		// Swap in the programs whose edited shaders finished linking
+		UpdateShaderLibrary(shaders, glState);
+		const ShaderProgram& instancedProgram = shaders.programs[instancedProgramIndex];
+
+		BeginGpuScope(gpuTimers, frameScope);
+
+		int viewportWidth = benchTarget.width, viewportHeight = benchTarget.height;
+		if (!options.bench)
+		{
+			glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+		}
+
+		// The deferred renderer draws the scene into the G-buffer, which is cleared instead
+		if (deferred)
+		{
+			ResizeGBuffer(deferredRenderer, glState, viewportWidth, viewportHeight);
+			BeginGeometryPass(deferredRenderer);
+		}
 
-		// "Unuse" the vertex array object
-		glBindVertexArray(0);
+		// Clear the colors in our off-screen framebuffer
+		BeginGpuScope(gpuTimers, clearScope);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		EndGpuScope(gpuTimers, clearScope);
 
+		//Transformation "Globals"
+		glm::mat4 PerspectiveProj = glm::perspective(glm::radians(fov), aspectRatio, 0.1f, 100.0f);
+		glm::mat4 camera = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+		glm::mat4 viewProj = PerspectiveProj * camera;
+
+		// Point lights of every cluster, or of the light volumes
+		if (deferred)
+		{
+			UploadDeferredLights(glState, deferredRenderer, pointLights);
+		}
+		else
+		{
+			AssignLightsToClusters(clusterGrid, pointLights, camera, fov, aspectRatio);
+			UploadClusterGrid(glState, clusterGrid);
+		}
+
+		// Per-frame uniforms
+		FrameBlock frameBlock;
+		frameBlock.viewProj = viewProj;
+		frameBlock.view = camera;
+		frameBlock.inverseViewProj = glm::inverse(viewProj);
+		frameBlock.cameraPos = cameraPos;
+		frameBlock.clusterScale = GetClusterScale(clusterGrid, viewportWidth, viewportHeight);
+		frameBlock.clusterCount = glm::ivec4(CLUSTER_COUNT_X, CLUSTER_COUNT_Y, CLUSTER_COUNT_Z, static_cast<int>(clusterGrid.lightCount));
+		UploadUniformBuffer(glState, uniformBuffers.frame, &frameBlock, sizeof(frameBlock));
+
+		// Global light
+		LightBlock lightBlock;
+		lightBlock.ambient = globalLight.ambient;
+		lightBlock.diffuse = globalLight.diffuse;
+		lightBlock.lightPos = lightPos;
+		lightBlock.specular = globalLight.specular;
+		lightBlock.specComp = globalLight.specComp;
+		UploadUniformBuffer(glState, uniformBuffers.light, &lightBlock, sizeof(lightBlock));
+
+		// The per-object blocks of the whole scene, computed in one pass straight into the mapped buffer
+		UpdateSceneGraph(sceneGraph, objectTransforms);
+		if (sceneGraph.updatedNodes > 0)
+		{
+			RefitBvh(sceneBvh, sceneGraph.objectBounds);
+		}
+		WriteObjectBlocks(glState, uniformBuffers, objectTransforms, viewProj);
+
+		CullBvh(sceneBvh, sceneGraph.objectBounds, ExtractFrustum(viewProj), visibleObjects, cullingStats);
+		float tanHalfFov = std::tan(glm::radians(fov) * 0.5f);
+
+		// Submit every draw of the frame, then issue them sorted
+		ClearRenderQueue(renderQueue);
+		if (options.instanced)
+		{
+			// Every part of every gate in a single draw call. The instances span the whole
+			// grid, so they sort as if they were right in front of the camera.
+			DrawPacket packet;
+			packet.key = MakeSortKey(RENDER_PASS_OPAQUE, instancedProgram.program, materials.texture, instancedVao, 0.0f, 100.0f);
+			packet.program = instancedProgram.program;
+			packet.positionOffsetLocation = instancedProgram.uniforms.positionOffset;
+			packet.positionScaleLocation = instancedProgram.uniforms.positionScale;
+			packet.vao = instancedVao;
+			packet.texture = materials.texture;
+			packet.mesh = &sceneMesh;
+			packet.range = gatePartRange;
+			packet.instanceCount = static_cast<GLsizei>(gateInstances.size());
+			packet.timerScope = gatesScope;
+			SubmitDraw(renderQueue, packet);
+		}
+
+		submittedObjects.clear();
+		for (int i : visibleObjects)
+		{
+			const SceneObjectRecord& object = scene.objects[i];
+
+			// Gate parts were already submitted by the instanced path
+			if (options.instanced && (object.flags & SCENE_OBJECT_GATE_PART))
+			{
+				continue;
+			}
+
+			// Depth of the object's origin along the view direction
+			float depth = -(camera * sceneGraph.nodes[sceneGraph.objectNodes[i]].world[3]).z;
+
+			// Variant of the object's material, draws sharing one end up next to each other
+			const ShaderProgram& program = shaders.programs[objectProgramIndices[i]];
+
+			// Geometry of the object's detail level, the scene's own when it has none
+			LodLevel level;
+			level.mesh = &sceneMesh;
+			level.range = GetObjectRange(object);
+			GetObjectLod(lodLibrary, i, sceneGraph.objectBounds[i], cameraPos, tanHalfFov, level);
+
+			DrawPacket packet;
+			packet.key = MakeSortKey(RENDER_PASS_OPAQUE, program.program, materials.texture, level.mesh->vao, depth, 100.0f);
+			packet.program = program.program;
+			packet.positionOffsetLocation = program.uniforms.positionOffset;
+			packet.positionScaleLocation = program.uniforms.positionScale;
+			packet.vao = level.mesh->vao;
+			packet.texture = materials.texture;
+			packet.mesh = level.mesh;
+			packet.range = level.range;
+			packet.objectBlock = static_cast<GLsizeiptr>(i);
+			packet.timerScope = objectsScope;
+			if (options.occlusionCulling)
+			{
+				packet.occlusionQuery = GetOcclusionQuery(occlusionCuller, i);
+			}
+			SubmitDraw(renderQueue, packet);
+			submittedObjects.push_back(i);
+
+			// The same draw with positions only, ahead of every opaque draw
+			if (options.depthPrepass)
+			{
+				const ShaderProgram& depthProgram = shaders.programs[depthProgramIndex];
+				packet.key = MakeSortKey(RENDER_PASS_DEPTH, depthProgram.program, materials.texture, GetDepthVertexArray(*level.mesh), depth, 100.0f);
+				packet.program = depthProgram.program;
+				packet.positionOffsetLocation = depthProgram.uniforms.positionOffset;
+				packet.positionScaleLocation = depthProgram.uniforms.positionScale;
+				packet.vao = GetDepthVertexArray(*level.mesh);
+				packet.timerScope = depthPrepassScope;
+				SubmitDraw(renderQueue, packet);
+			}
+		}
+
+		SortRenderQueue(renderQueue);
+		ExecuteRenderQueue(renderQueue, glState, uniformBuffers, gpuTimers);
+
+		// Test the boxes of this frame's objects against the depth just drawn, for the next frame
+		if (options.occlusionCulling)
+		{
+			BeginGpuScope(gpuTimers, occlusionScope);
+			const ShaderProgram& occlusionProgram = shaders.programs[occlusionProgramIndex];
+			IssueOcclusionQueries(occlusionCuller, glState, occlusionProgram.program, occlusionProgram.uniforms.boxMin, occlusionProgram.uniforms.boxMax, submittedObjects, sceneGraph.objectBounds, cameraPos);
+			EndGpuScope(gpuTimers, occlusionScope);
+		}
+
+		if (deferred)
+		{
+			BeginGpuScope(gpuTimers, lightingScope);
+			RunLightingPass(deferredRenderer, glState, options.bench ? benchTarget.fbo : 0,
+				shaders.programs[globalLightProgramIndex].program, shaders.programs[pointLightProgramIndex].program);
+			EndGpuScope(gpuTimers, lightingScope);
+		}
+		EndGpuScope(gpuTimers, frameScope);
+
+		frameIndex++;
+		if (options.bench)
+		{
+			// Nothing is shown, so only make sure the frame gets submitted
+			glFlush();
+			benchCpuFrameTimes.push_back(static_cast<float>((glfwGetTime() - currentFrame) * 1000.0));
+			continue;
+		}
 
 		// Tell GLFW to swap the screen buffer with the offscreen buffer
 		glfwSwapBuffers(window);
@@ -894,109 +759,201 @@ int main()
 
 	// --- Cleanup ---
 
-	// Make sure to delete the shader program
-	glDeleteProgram(program);
-
-	// Delete the VBO that contains our vertices
-	glDeleteBuffers(1, &vbo);
-
-	// Delete the vertex array object
-	glDeleteVertexArrays(1, &vao);
+	if (options.bench)
+	{
+		// Wait for the GPU, then collect the timer queries still in flight
+		glFinish();
+		double benchSeconds = glfwGetTime() - benchStartTime;
+		for (int i = 0; i < GPU_TIMER_FRAME_LATENCY; i++)
+		{
+			BeginGpuTimerFrame(gpuTimers);
+		}
+		PrintBenchReport(benchTarget, frameIndex, benchSeconds, benchCpuFrameTimes, gpuTimers, options.vertexLayout, scene.vertexCount + lodLibrary.vertices.size());
+		DeleteBenchTarget(benchTarget);
+	}
 
-	// Remember to tell GLFW to clean itself up before exiting the application
-	glfwTerminate();
+	StopInputRecording(inputRecorder);
+	if (inputReplay.active)
+	{
+		std::cerr << "Replayed " << frameIndex << " frames" << std::endl;
+		CloseInputReplay(inputReplay);
+	}
 
-	return 0;
-}
+	DeleteGpuTimers(gpuTimers);
 
-/**
- * @brief Creates a shader program based on the provided file paths for the vertex and fragment shaders.
- * @param[in] vertexShaderFilePath Vertex shader file path
- * @param[in] fragmentShaderFilePath Fragment shader file path
- * @return OpenGL handle to the created shader program
- */
-GLuint CreateShaderProgram(const std::string& vertexShaderFilePath, const std::string& fragmentShaderFilePath)
-{
-	GLuint vertexShader = CreateShaderFromFile(GL_VERTEX_SHADER, vertexShaderFilePath);
-	GLuint fragmentShader = CreateShaderFromFile(GL_FRAGMENT_SHADER, fragmentShaderFilePath);
-
-	GLuint program = glCreateProgram();
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
-
-	glLinkProgram(program);
-
-	glDetachShader(program, vertexShader);
-	glDeleteShader(vertexShader);
-	glDetachShader(program, fragmentShader);
-	glDeleteShader(fragmentShader);
-
-	// Check shader program link status
-	GLint linkStatus;
-	glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
-	if (linkStatus != GL_TRUE) {
-		char infoLog[512];
-		GLsizei infoLogLen = sizeof(infoLog);
-		glGetProgramInfoLog(program, infoLogLen, &infoLogLen, infoLog);
-		std::cerr << "program link error: " << infoLog << std::endl;
-	}
+	// Make sure to delete the shader programs
+	DeleteShaderLibrary(shaders);
 
-	return program;
-}
+	// Delete the instanced gate buffers
+	glDeleteBuffers(1, &instanceVbo);
+	glDeleteVertexArrays(1, &instancedVao);
 
-/**
- * @brief Creates a shader based on the provided shader type and the path to the file containing the shader source.
- * @param[in] shaderType Shader type
- * @param[in] shaderFilePath Path to the file containing the shader source
- * @return OpenGL handle to the created shader
- */
-GLuint CreateShaderFromFile(const GLuint& shaderType, const std::string& shaderFilePath)
-{
-	std::ifstream shaderFile(shaderFilePath);
-	if (shaderFile.fail())
+	// Delete the buffers backing the uniform blocks
+	DeleteUniformBuffers(uniformBuffers);
+	DeleteClusterGrid(clusterGrid);
+	if (deferred)
 	{
-		std::cerr << "Unable to open shader file: " << shaderFilePath << std::endl;
-		return 0;
+		DeleteDeferredRenderer(deferredRenderer);
 	}
-
-	std::string shaderSource;
-	std::string temp;
-	while (std::getline(shaderFile, temp))
+	if (options.occlusionCulling)
 	{
-		shaderSource += temp + "\n";
+		DeleteOcclusionCuller(occlusionCuller);
 	}
-	shaderFile.close();
 
-	return CreateShaderFromSource(shaderType, shaderSource);
+	// Delete the buffers and vertex array objects of the scene mesh and the generated detail levels
+	DeleteLodLibrary(lodLibrary);
+	DeleteMesh(sceneMesh);
+
+	// Delete the textures, after the loader no longer uses them
+	StopTextureLoader(textureLoader);
+	DeleteMaterialArray(materials);
+
+	// Unmap the scene file
+	UnloadScene(scene);
+
+	// Remember to tell GLFW to clean itself up before exiting the application
+	glfwTerminate();
+
+	return 0;
 }
 
 /**
- * @brief Creates a shader based on the provided shader type and the string containing the shader source.
- * @param[in] shaderType Shader type
- * @param[in] shaderSource Shader source string
- * @return OpenGL handle to the created shader
+ * @brief Parses the command line arguments.
+ * @param[in] argc Number of arguments
+ * @param[in] argv Argument strings
+ * @return Parsed options, with defaults for anything not specified
  */
-GLuint CreateShaderFromSource(const GLuint& shaderType, const std::string& shaderSource)
+AppOptions ParseCommandLine(int argc, char* argv[])
 {
-	GLuint shader = glCreateShader(shaderType);
-
-	const char* shaderSourceCStr = shaderSource.c_str();
-	GLint shaderSourceLen = static_cast<GLint>(shaderSource.length());
-	glShaderSource(shader, 1, &shaderSourceCStr, &shaderSourceLen);
-	glCompileShader(shader);
+	AppOptions options;
+	bool scenePathGiven = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--instanced")
+		{
+			options.instanced = true;
+		}
+		else if (arg == "--gates" && i + 1 < argc)
+		{
+			options.gateCount = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--scene" && i + 1 < argc)
+		{
+			options.scenePath = argv[++i];
+			scenePathGiven = true;
+		}
+		else if (arg == "--forest" && i + 1 < argc)
+		{
+			options.forestGates = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--forest-lights" && i + 1 < argc)
+		{
+			options.forestLights = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (arg == "--forest-textures" && i + 1 < argc)
+		{
+			options.forestTextures = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--packed-vertices")
+		{
+			options.vertexLayout = VERTEX_LAYOUT_PACKED;
+		}
+		else if (arg == "--split-streams")
+		{
+			options.vertexStreams = VERTEX_STREAMS_SPLIT;
+		}
+		else if (arg == "--depth-prepass")
+		{
+			options.depthPrepass = true;
+		}
+		else if (arg == "--compress-textures")
+		{
+			options.compressTextures = true;
+		}
+		else if (arg == "--material-size" && i + 1 < argc)
+		{
+			options.materialSize = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--lights" && i + 1 < argc)
+		{
+			options.lightCount = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (arg == "--occlusion-culling")
+		{
+			options.occlusionCulling = true;
+		}
+		else if (arg == "--gpu-timers")
+		{
+			options.gpuTimers = true;
+		}
+		else if (arg == "--bench")
+		{
+			options.bench = true;
+		}
+		else if (arg == "--bench-frames" && i + 1 < argc)
+		{
+			options.benchFrames = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--bench-size" && i + 1 < argc)
+		{
+			std::string size = argv[++i];
+			size_t separator = size.find('x');
+			if (separator != std::string::npos)
+			{
+				options.benchWidth = std::max(1, std::atoi(size.substr(0, separator).c_str()));
+				options.benchHeight = std::max(1, std::atoi(size.substr(separator + 1).c_str()));
+			}
+			else
+			{
+				std::cerr << "Expected WxH after --bench-size, got " << size << std::endl;
+			}
+		}
+		else if (arg == "--bench-context" && i + 1 < argc)
+		{
+			std::string context = argv[++i];
+			if (!ParseBenchContext(context, options.benchContext))
+			{
+				std::cerr << "Unknown benchmark context: " << context << std::endl;
+			}
+		}
+		else if (arg == "--renderer" && i + 1 < argc)
+		{
+			std::string renderer = argv[++i];
+			if (!ParseRendererType(renderer, options.renderer))
+			{
+				std::cerr << "Unknown renderer: " << renderer << std::endl;
+			}
+		}
+		else if (arg == "--bench-transforms")
+		{
+			options.benchTransforms = 10000;
+			if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+			{
+				options.benchTransforms = std::max(1, std::atoi(argv[++i]));
+			}
+		}
+		else if (arg == "--record" && i + 1 < argc)
+		{
+			options.recordPath = argv[++i];
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			options.replayPath = argv[++i];
+		}
+		else
+		{
+			std::cerr << "Ignoring unknown argument: " << arg << std::endl;
+		}
+	}
 
-	// Check compilation status
-	GLint compileStatus;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus);
-	if (compileStatus == GL_FALSE)
+	// A generated forest must not replace the shrine
+	if (options.forestGates > 0 && !scenePathGiven)
 	{
-		char infoLog[512];
-		GLsizei infoLogLen = sizeof(infoLog);
-		glGetShaderInfoLog(shader, infoLogLen, &infoLogLen, infoLog);
-		std::cerr << "shader compilation error: " << infoLog << std::endl;
+		options.scenePath = "forest.scene";
 	}
 
-	return shader;
+	return options;
 }
 
 /**
@@ -1006,22 +963,24 @@ GLuint CreateShaderFromSource(const GLuint& shaderType, const std::string& shade
  * @param[in] height New height
  */
 
-void processInput(GLFWwindow *window){
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS){
+void processInput(GLFWwindow *window, uint32_t keys){
+	// Escape still quits a replay early
+	if ((keys & INPUT_KEY_ESCAPE) || glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS){
 		glfwSetWindowShouldClose(window, true);
 	}
 
-	float cameraSpeed = static_cast<float>(0.005 * deltaTime);
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS){
+	// Units per second
+	float cameraSpeed = 5.0f * deltaTime;
+	if (keys & INPUT_KEY_W){
 		cameraPos += cameraSpeed * cameraFront;
 	}
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS){
+	if (keys & INPUT_KEY_S){
 		cameraPos -= cameraSpeed * cameraFront;
 	}
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS){
+	if (keys & INPUT_KEY_A){
 		cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
 	}
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS){
+	if (keys & INPUT_KEY_D){
 		cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;;
 	}
 }
@@ -1033,9 +992,17 @@ void FramebufferSizeChangedCallback(GLFWwindow* window, int width, int height)
 }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn){
+	if (inputReplay.active){
+		return;
+	}
+
 	float xpos = static_cast<float>(xposIn);
 	float ypos = static_cast<float>(yposIn);
+	RecordInputEvent(inputRecorder, INPUT_EVENT_CURSOR, xpos, ypos);
+	ApplyCursorInput(xpos, ypos);
+}
 
+void ApplyCursorInput(float xpos, float ypos){
 	if (firstMouse){
 		lastX = xpos;
 		lastY = ypos;
@@ -1069,7 +1036,16 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn){
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset){
-	fov -= (float)yoffset;
+	if (inputReplay.active){
+		return;
+	}
+
+	RecordInputEvent(inputRecorder, INPUT_EVENT_SCROLL, (float)xoffset, (float)yoffset);
+	ApplyScrollInput((float)yoffset);
+}
+
+void ApplyScrollInput(float yoffset){
+	fov -= yoffset;
 	if (fov < 1.0f){
 		fov = 1.0f;
 	}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ---------------
+// Read-only memory-mapped files
+// ---------------
+
+/**
+ * Struct containing a read-only view of a whole file mapped into memory
+ */
+struct MappedFile
+{
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+/**
+ * @brief Unmaps a file mapped with MapFile(). Does nothing if the file is not mapped.
+ * @param[in,out] mappedFile File to unmap
+ */
+inline void UnmapFile(MappedFile& mappedFile)
+{
+#ifdef _WIN32
+	if (mappedFile.data != nullptr)
+	{
+		UnmapViewOfFile(mappedFile.data);
+	}
+	if (mappedFile.mapping != nullptr)
+	{
+		CloseHandle(mappedFile.mapping);
+	}
+	if (mappedFile.file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(mappedFile.file);
+	}
+#else
+	if (mappedFile.data != nullptr)
+	{
+		munmap(const_cast<unsigned char*>(mappedFile.data), mappedFile.size);
+	}
+	if (mappedFile.fd != -1)
+	{
+		close(mappedFile.fd);
+	}
+#endif
+
+	mappedFile = MappedFile();
+}
+
+/**
+ * @brief Maps a whole file into memory for reading. Pages are loaded on first access,
+ * so the cost of opening scales with how much of the file is actually read.
+ * @param[in] filePath Path to the file
+ * @param[out] mappedFile Mapped file on success
+ * @return True if the file was mapped, false otherwise
+ */
+inline bool MapFile(const std::string& filePath, MappedFile& mappedFile)
+{
+	UnmapFile(mappedFile);
+
+#ifdef _WIN32
+	mappedFile.file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mappedFile.file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mappedFile.file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		UnmapFile(mappedFile);
+		return false;
+	}
+	mappedFile.size = static_cast<size_t>(fileSize.QuadPart);
+
+	mappedFile.mapping = CreateFileMappingA(mappedFile.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappedFile.mapping == nullptr)
+	{
+		UnmapFile(mappedFile);
+		return false;
+	}
+
+	mappedFile.data = static_cast<const unsigned char*>(MapViewOfFile(mappedFile.mapping, FILE_MAP_READ, 0, 0, 0));
+	if (mappedFile.data == nullptr)
+	{
+		UnmapFile(mappedFile);
+		return false;
+	}
+#else
+	mappedFile.fd = open(filePath.c_str(), O_RDONLY);
+	if (mappedFile.fd == -1)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(mappedFile.fd, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		UnmapFile(mappedFile);
+		return false;
+	}
+	mappedFile.size = static_cast<size_t>(fileStat.st_size);
+
+	void* data = mmap(nullptr, mappedFile.size, PROT_READ, MAP_PRIVATE, mappedFile.fd, 0);
+	if (data == MAP_FAILED)
+	{
+		std::cerr << "Unable to map file: " << filePath << std::endl;
+		mappedFile.size = 0;
+		UnmapFile(mappedFile);
+		return false;
+	}
+	mappedFile.data = static_cast<const unsigned char*>(data);
+#endif
+
+	return true;
+}
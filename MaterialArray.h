@@ -0,0 +1,161 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// ---------------
+// Material texture array
+// ---------------
+//
+// Every scene texture is one layer of a single GL_TEXTURE_2D_ARRAY, so the whole scene
+// samples from one texture bound once per frame. Objects select their layer through
+// ObjectBlock::layer (or InstanceData::texIndex for the instanced path).
+// All layers share one size, so images are resampled to it when they are imported.
+
+/**
+ * Texture unit the material array is bound to. main.fsh reads it through the materials sampler.
+ */
+const GLint MATERIAL_TEXTURE_UNIT = 0;
+
+/**
+ * Struct containing the texture array holding every scene material
+ */
+struct MaterialArray
+{
+	GLuint texture = 0;
+	int layerSize = 0;		// Width and height of every layer
+	int levelCount = 0;
+	int layerCount = 0;
+
+	// GL_RGB8, or the compressed format the driver picked for GL_COMPRESSED_RGB
+	GLenum internalFormat = GL_RGB8;
+	bool compressed = false;
+};
+
+/**
+ * @brief Gets the number of mip levels of a full chain, down to 1x1.
+ * @param[in] size Width and height of the base level
+ * @return Number of mip levels
+ */
+inline int GetMipLevelCount(int size)
+{
+	int levelCount = 1;
+	while (size > 1)
+	{
+		size /= 2;
+		levelCount++;
+	}
+	return levelCount;
+}
+
+/**
+ * @brief Resamples RGB8 pixels to another size with bilinear filtering.
+ * When shrinking by more than half this skips source pixels, which is fine since the
+ * result is box filtered again by BuildMipChain().
+ * @param[in] pixels Tightly packed RGB8 pixels of the source image
+ * @param[in] width Width of the source image
+ * @param[in] height Height of the source image
+ * @param[in] newWidth Width of the resampled image
+ * @param[in] newHeight Height of the resampled image
+ * @return Tightly packed RGB8 pixels of the resampled image
+ */
+inline std::vector<unsigned char> ResampleImage(const unsigned char* pixels, int width, int height, int newWidth, int newHeight)
+{
+	std::vector<unsigned char> resampled(static_cast<size_t>(newWidth) * newHeight * 3);
+	float scaleX = static_cast<float>(width) / newWidth;
+	float scaleY = static_cast<float>(height) / newHeight;
+	for (int y = 0; y < newHeight; y++)
+	{
+		// Sample at pixel centers, so both images cover the same area
+		float sourceY = std::max(0.0f, (y + 0.5f) * scaleY - 0.5f);
+		int y0 = std::min(static_cast<int>(sourceY), height - 1);
+		int y1 = std::min(y0 + 1, height - 1);
+		float fy = sourceY - y0;
+		for (int x = 0; x < newWidth; x++)
+		{
+			float sourceX = std::max(0.0f, (x + 0.5f) * scaleX - 0.5f);
+			int x0 = std::min(static_cast<int>(sourceX), width - 1);
+			int x1 = std::min(x0 + 1, width - 1);
+			float fx = sourceX - x0;
+			for (int c = 0; c < 3; c++)
+			{
+				float top = pixels[(y0 * width + x0) * 3 + c] * (1.0f - fx) + pixels[(y0 * width + x1) * 3 + c] * fx;
+				float bottom = pixels[(y1 * width + x0) * 3 + c] * (1.0f - fx) + pixels[(y1 * width + x1) * 3 + c] * fx;
+				resampled[(static_cast<size_t>(y) * newWidth + x) * 3 + c] = static_cast<unsigned char>(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+	return resampled;
+}
+
+/**
+ * @brief Sets the sampling parameters of the texture bound to GL_TEXTURE_2D_ARRAY.
+ */
+inline void SetMaterialTextureParameters()
+{
+	// Trilinear filtering across the mip chain
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+/**
+ * @brief Creates the material array with every layer filled with a mid-grey placeholder,
+ * shown until the real image is uploaded.
+ * @param[in] layerCount Number of layers, one per scene texture
+ * @param[in] layerSize Width and height of every layer
+ * @param[in] compress Whether to store the layers block-compressed
+ * @return Struct containing the created texture array
+ */
+inline MaterialArray CreateMaterialArray(int layerCount, int layerSize, bool compress)
+{
+	MaterialArray materials;
+	materials.layerSize = layerSize;
+	materials.levelCount = GetMipLevelCount(layerSize);
+	materials.layerCount = std::max(1, layerCount);
+
+	glGenTextures(1, &materials.texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, materials.texture);
+	SetMaterialTextureParameters();
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, materials.levelCount - 1);
+
+	// Every level of every layer is specified at once, the driver compresses the
+	// placeholder itself when a generic compressed format is requested
+	std::vector<unsigned char> placeholder(static_cast<size_t>(layerSize) * layerSize * materials.layerCount * 3, 128);
+	GLenum internalFormat = compress ? GL_COMPRESSED_RGB : GL_RGB8;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0, size = layerSize; i < materials.levelCount; i++, size = std::max(1, size / 2))
+	{
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, i, internalFormat, size, size, materials.layerCount, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder.data());
+	}
+
+	GLint isCompressed = GL_FALSE;
+	GLint actualFormat = GL_RGB8;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_COMPRESSED, &isCompressed);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_INTERNAL_FORMAT, &actualFormat);
+	materials.compressed = isCompressed == GL_TRUE;
+	materials.internalFormat = static_cast<GLenum>(actualFormat);
+	if (compress && !materials.compressed)
+	{
+		std::cerr << "The driver offers no compressed format for GL_COMPRESSED_RGB, textures stay uncompressed" << std::endl;
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	return materials;
+}
+
+/**
+ * @brief Deletes the texture array.
+ * @param[in,out] materials Material array to delete
+ */
+inline void DeleteMaterialArray(MaterialArray& materials)
+{
+	glDeleteTextures(1, &materials.texture);
+	materials = MaterialArray();
+}
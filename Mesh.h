@@ -0,0 +1,390 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Vertex.h"
+
+// ---------------
+// Indexed meshes
+// ---------------
+
+/**
+ * Struct containing a range of indices inside a mesh's element buffer.
+ * Each object draws one range with a single call.
+ */
+struct MeshRange
+{
+	GLsizei firstIndex = 0;
+	GLsizei indexCount = 0;
+};
+
+/**
+ * Struct containing the buffers of an indexed mesh. The VAO captures both the
+ * vertex attribute layout and the element buffer, so binding it is all a draw needs.
+ */
+struct Mesh
+{
+	GLuint vao = 0;
+	GLuint vbo = 0;					// Every attribute when interleaved, every attribute but the position when split
+	GLuint ebo = 0;
+	GLenum indexType = GL_UNSIGNED_SHORT;
+
+	// Packed positions are offset + normalized position * scale, see SetMeshDequantization()
+	VertexLayout layout = VERTEX_LAYOUT_FLOAT;
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+
+	// Split streams only, 0 when interleaved
+	GLuint positionVbo = 0;			// Positions alone
+	GLuint depthVao = 0;			// Reads only the positions, for depth-only passes
+};
+
+/**
+ * @brief Sets up attribute 0 to read positions from a buffer.
+ * Expects the vertex array object to configure to be bound.
+ * @param[in] layout Layout of the vertices
+ * @param[in] buffer OpenGL handle to the buffer holding the positions
+ * @param[in] stride Distance between two positions in the buffer
+ */
+inline void SetPositionAttribute(VertexLayout layout, GLuint buffer, GLsizei stride)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	// Vertex attribute 0 - Position
+	glEnableVertexAttribArray(0);
+	if (layout == VERTEX_LAYOUT_PACKED)
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)0);
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	}
+}
+
+/**
+ * @brief Sets up attributes 0 to 3 to read vertices from one interleaved buffer, or from a
+ * position buffer and an attribute buffer holding the rest of every vertex.
+ * Expects the vertex array object to configure to be bound.
+ * @param[in] layout Layout of the vertices
+ * @param[in] positionBuffer OpenGL handle to the buffer holding the positions
+ * @param[in] attributeBuffer OpenGL handle to the buffer holding the other attributes, the same buffer when interleaved
+ */
+inline void SetVertexAttributes(VertexLayout layout, GLuint positionBuffer, GLuint attributeBuffer)
+{
+	// Split, the bytes of a vertex before its color go to the position buffer and the rest to the attribute buffer
+	GLsizei stride = static_cast<GLsizei>(GetVertexSize(layout));
+	GLsizei positionSize = static_cast<GLsizei>(GetVertexPositionSize(layout));
+	bool split = positionBuffer != attributeBuffer;
+	GLsizei attributeStride = split ? stride - positionSize : stride;
+	size_t attributeBase = split ? positionSize : 0;
+
+	SetPositionAttribute(layout, positionBuffer, split ? positionSize : stride);
+	glBindBuffer(GL_ARRAY_BUFFER, attributeBuffer);
+
+	if (layout == VERTEX_LAYOUT_PACKED)
+	{
+		// The shader inputs stay the same, the attributes are converted on fetch
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, attributeStride, (void*)(offsetof(PackedVertex, r) - attributeBase));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, attributeStride, (void*)(offsetof(PackedVertex, u) - attributeBase));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, attributeStride, (void*)(offsetof(PackedVertex, normal) - attributeBase));
+		return;
+	}
+
+	// Vertex attribute 1 - Color
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, attributeStride, (void*)(offsetof(Vertex, r) - attributeBase));
+
+	// Vertex attribute 2 - UV coordinate
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, attributeStride, (void*)(offsetof(Vertex, u) - attributeBase));
+
+	// Vertex attribute 3 - Normal Vertex
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, attributeStride, (void*)(offsetof(Vertex, nx) - attributeBase));
+}
+
+/**
+ * @brief Sets up attributes 0 to 3 to read the vertices of a mesh, whichever way they are stored.
+ * Expects the vertex array object to configure to be bound.
+ * @param[in] mesh Mesh to read
+ */
+inline void SetMeshVertexAttributes(const Mesh& mesh)
+{
+	SetVertexAttributes(mesh.layout, mesh.positionVbo != 0 ? mesh.positionVbo : mesh.vbo, mesh.vbo);
+}
+
+/**
+ * @brief Appends the indices of consecutive 4-vertex triangle strips as a triangle list.
+ * @param[in,out] indices Index list to append to
+ * @param[in] firstVertex Index of the first vertex of the first strip
+ * @param[in] quadCount Number of 4-vertex strips
+ * @return Range covering the appended indices
+ */
+inline MeshRange AppendQuadStripIndices(std::vector<GLushort>& indices, GLushort firstVertex, int quadCount)
+{
+	MeshRange range;
+	range.firstIndex = static_cast<GLsizei>(indices.size());
+
+	for (int quad = 0; quad < quadCount; quad++)
+	{
+		GLushort v = static_cast<GLushort>(firstVertex + quad * 4);
+
+		// A 4-vertex strip is made of the triangles (0, 1, 2) and (2, 1, 3)
+		indices.push_back(v);
+		indices.push_back(v + 1);
+		indices.push_back(v + 2);
+		indices.push_back(v + 2);
+		indices.push_back(v + 1);
+		indices.push_back(v + 3);
+	}
+
+	range.indexCount = static_cast<GLsizei>(indices.size()) - range.firstIndex;
+	return range;
+}
+
+/**
+ * @brief Converts a float to a half float, rounding to nearest. Values too small for a
+ * normal half float become zero, values too large become infinity.
+ * @param[in] value Value to convert
+ * @return Bits of the half float
+ */
+inline GLhalf PackHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	int exponent = static_cast<int>((bits >> 23) & 0xFFu) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFFu;
+	if (exponent <= 0)
+	{
+		return static_cast<GLhalf>(sign);
+	}
+	if (exponent >= 31)
+	{
+		return static_cast<GLhalf>(sign | 0x7C00u);
+	}
+
+	// A carry out of the mantissa correctly bumps the exponent
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	half += (mantissa >> 12) & 1u;
+	return static_cast<GLhalf>(std::min(half, sign | 0x7C00u));
+}
+
+/**
+ * @brief Packs a normal as GL_INT_2_10_10_10_REV, 10-bit signed normalized components.
+ * @param[in] x Normal x component
+ * @param[in] y Normal y component
+ * @param[in] z Normal z component
+ * @return Packed normal, w is 0
+ */
+inline GLuint PackNormal(float x, float y, float z)
+{
+	float components[3] = { x, y, z };
+	GLuint packed = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		int quantized = static_cast<int>(std::lround(std::min(std::max(components[i], -1.0f), 1.0f) * 511.0f));
+		packed |= (static_cast<GLuint>(quantized) & 0x3FFu) << (i * 10);
+	}
+	return packed;
+}
+
+/**
+ * @brief Packs vertices, quantizing the positions to 16 bits across their bounds.
+ * @param[in] vertices Pointer to the vertices
+ * @param[in] vertexCount Number of vertices
+ * @param[out] positionOffset Smallest position, what a quantized 0 stands for
+ * @param[out] positionScale Extent of the positions, what a quantized 1 adds to the offset
+ * @return Packed vertices
+ */
+inline std::vector<PackedVertex> PackVertices(const Vertex* vertices, size_t vertexCount, glm::vec3& positionOffset, glm::vec3& positionScale)
+{
+	glm::vec3 minPosition(0.0f), maxPosition(0.0f);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		glm::vec3 position(vertices[i].x, vertices[i].y, vertices[i].z);
+		minPosition = i == 0 ? position : glm::min(minPosition, position);
+		maxPosition = i == 0 ? position : glm::max(maxPosition, position);
+	}
+
+	// A flat axis still needs a nonzero scale to divide by
+	positionOffset = minPosition;
+	positionScale = maxPosition - minPosition;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		positionScale[axis] = positionScale[axis] > 0.0f ? positionScale[axis] : 1.0f;
+	}
+
+	std::vector<PackedVertex> packed(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		glm::vec3 normalized = (glm::vec3(vertex.x, vertex.y, vertex.z) - positionOffset) / positionScale;
+
+		PackedVertex& out = packed[i];
+		out.x = static_cast<GLushort>(std::lround(glm::clamp(normalized.x, 0.0f, 1.0f) * 65535.0f));
+		out.y = static_cast<GLushort>(std::lround(glm::clamp(normalized.y, 0.0f, 1.0f) * 65535.0f));
+		out.z = static_cast<GLushort>(std::lround(glm::clamp(normalized.z, 0.0f, 1.0f) * 65535.0f));
+		out.pad = 0;
+		out.r = vertex.r;
+		out.g = vertex.g;
+		out.b = vertex.b;
+		out.a = 255;
+		out.u = PackHalf(vertex.u);
+		out.v = PackHalf(vertex.v);
+		out.normal = PackNormal(vertex.nx, vertex.ny, vertex.nz);
+	}
+	return packed;
+}
+
+/**
+ * @brief Creates a mesh from vertex and index data.
+ * @param[in] vertices Pointer to the vertices
+ * @param[in] vertexCount Number of vertices
+ * @param[in] indices Pointer to the 16-bit indices
+ * @param[in] indexCount Number of indices
+ * @param[in] layout Layout to store the vertices in on the GPU
+ * @param[in] streams Whether the positions get a buffer of their own
+ * @return Struct containing the created buffers and vertex array objects
+ */
+inline Mesh CreateMesh(const Vertex* vertices, size_t vertexCount, const GLushort* indices, size_t indexCount,
+	VertexLayout layout = VERTEX_LAYOUT_FLOAT, VertexStreams streams = VERTEX_STREAMS_INTERLEAVED)
+{
+	Mesh mesh;
+	mesh.layout = layout;
+
+	std::vector<PackedVertex> packed;
+	const unsigned char* vertexBytes = reinterpret_cast<const unsigned char*>(vertices);
+	if (layout == VERTEX_LAYOUT_PACKED)
+	{
+		packed = PackVertices(vertices, vertexCount, mesh.positionOffset, mesh.positionScale);
+		vertexBytes = reinterpret_cast<const unsigned char*>(packed.data());
+	}
+	size_t stride = GetVertexSize(layout);
+
+	glGenBuffers(1, &mesh.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+	if (streams == VERTEX_STREAMS_SPLIT)
+	{
+		// Every vertex is cut in two, its position and everything after it
+		size_t positionSize = GetVertexPositionSize(layout);
+		std::vector<unsigned char> positions(vertexCount * positionSize);
+		std::vector<unsigned char> attributes(vertexCount * (stride - positionSize));
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			std::memcpy(&positions[i * positionSize], vertexBytes + i * stride, positionSize);
+			std::memcpy(&attributes[i * (stride - positionSize)], vertexBytes + i * stride + positionSize, stride - positionSize);
+		}
+		glBufferData(GL_ARRAY_BUFFER, attributes.size(), attributes.data(), GL_STATIC_DRAW);
+
+		glGenBuffers(1, &mesh.positionVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.positionVbo);
+		glBufferData(GL_ARRAY_BUFFER, positions.size(), positions.data(), GL_STATIC_DRAW);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, vertexBytes, GL_STATIC_DRAW);
+	}
+
+	// Create a vertex array object that contains data on how to map vertex attributes
+	// (e.g., position, color) to vertex shader properties.
+	glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+	SetMeshVertexAttributes(mesh);
+
+	// The element buffer binding is part of the vertex array object's state
+	glGenBuffers(1, &mesh.ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indices, GL_STATIC_DRAW);
+
+	// Depth-only passes fetch nothing but the positions
+	if (streams == VERTEX_STREAMS_SPLIT)
+	{
+		glGenVertexArrays(1, &mesh.depthVao);
+		glBindVertexArray(mesh.depthVao);
+		SetPositionAttribute(layout, mesh.positionVbo, static_cast<GLsizei>(GetVertexPositionSize(layout)));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return mesh;
+}
+
+/**
+ * @brief Gets the vertex array object a depth-only pass draws a mesh with.
+ * @param[in] mesh Mesh to draw
+ * @return The position-only vertex array object with split streams, the regular one otherwise
+ */
+inline GLuint GetDepthVertexArray(const Mesh& mesh)
+{
+	return mesh.depthVao != 0 ? mesh.depthVao : mesh.vao;
+}
+
+/**
+ * @brief Sets the uniforms the vertex shader dequantizes the positions of a packed mesh with.
+ * Expects the program to be in use. Does nothing for meshes with float vertices.
+ * @param[in] positionOffsetLocation Location of the positionOffset uniform of the program in use
+ * @param[in] positionScaleLocation Location of the positionScale uniform of the program in use
+ * @param[in] mesh Mesh about to be drawn
+ */
+inline void SetMeshDequantization(GLint positionOffsetLocation, GLint positionScaleLocation, const Mesh& mesh)
+{
+	if (mesh.layout == VERTEX_LAYOUT_PACKED)
+	{
+		glUniform3fv(positionOffsetLocation, 1, &mesh.positionOffset.x);
+		glUniform3fv(positionScaleLocation, 1, &mesh.positionScale.x);
+	}
+}
+
+/**
+ * @brief Draws a range of a mesh. Expects the mesh's vertex array object to be bound.
+ * @param[in] mesh Mesh to draw
+ * @param[in] range Range of indices to draw
+ */
+inline void DrawMeshRange(const Mesh& mesh, const MeshRange& range)
+{
+	size_t indexSize = (mesh.indexType == GL_UNSIGNED_INT) ? sizeof(GLuint) : sizeof(GLushort);
+	glDrawElements(GL_TRIANGLES, range.indexCount, mesh.indexType, (void*)(range.firstIndex * indexSize));
+}
+
+/**
+ * @brief Draws several instances of a range of a mesh. Expects a vertex array object
+ * using the mesh's buffers to be bound.
+ * @param[in] mesh Mesh to draw
+ * @param[in] range Range of indices to draw
+ * @param[in] instanceCount Number of instances
+ */
+inline void DrawMeshRangeInstanced(const Mesh& mesh, const MeshRange& range, GLsizei instanceCount)
+{
+	size_t indexSize = (mesh.indexType == GL_UNSIGNED_INT) ? sizeof(GLuint) : sizeof(GLushort);
+	glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, mesh.indexType, (void*)(range.firstIndex * indexSize), instanceCount);
+}
+
+/**
+ * @brief Deletes the buffers and vertex array objects of a mesh.
+ * @param[in,out] mesh Mesh to delete
+ */
+inline void DeleteMesh(Mesh& mesh)
+{
+	glDeleteVertexArrays(1, &mesh.vao);
+	glDeleteVertexArrays(1, &mesh.depthVao);
+	glDeleteBuffers(1, &mesh.vbo);
+	glDeleteBuffers(1, &mesh.positionVbo);
+	glDeleteBuffers(1, &mesh.ebo);
+	mesh = Mesh();
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "FrustumCulling.h"
+#include "GLState.h"
+
+// ---------------
+// Occlusion culling
+// ---------------
+//
+// After the opaque objects are drawn, the bounding box of every object that survived
+// frustum culling is drawn against the depth buffer, without writing color or depth,
+// inside a GL_ANY_SAMPLES_PASSED query. On the next frame, the object is drawn inside a
+// conditional render on that query, so the GPU skips it if none of its box was visible,
+// without the CPU ever waiting for the result. Objects hidden behind others this frame
+// stop costing anything from the next frame on; objects coming into view may appear one
+// frame late.
+//
+// The results are only read back for the occluded object counter of the debug readout, so
+// culling itself never queries a result on the CPU.
+
+const float OCCLUSION_BOX_MARGIN = 0.05f;	// Keeps a box in front of the surfaces of its own object
+
+/**
+ * Struct containing the occlusion queries of the scene objects
+ */
+struct OcclusionCuller
+{
+	std::vector<GLuint> queries;			// One per scene object
+	std::vector<int> queriedFrames;			// Frame each object's query was last issued, -1 for never
+	std::vector<int> queriedObjects;		// Objects whose query was issued on the last frame
+	GLuint boxVao = 0;						// Empty, the box corners come from gl_VertexID
+	int frame = 0;
+
+	// Counters of the results read back by the last ReadOcclusionResults()
+	int tested = 0;
+	int occluded = 0;
+};
+
+/**
+ * @brief Creates one query per scene object.
+ * @param[in] objectCount Number of scene objects
+ * @return Struct containing the queries
+ */
+inline OcclusionCuller CreateOcclusionCuller(size_t objectCount)
+{
+	OcclusionCuller culler;
+	culler.queries.resize(objectCount);
+	culler.queriedFrames.assign(objectCount, -1);
+	if (objectCount > 0)
+	{
+		glGenQueries(static_cast<GLsizei>(objectCount), culler.queries.data());
+	}
+	glGenVertexArrays(1, &culler.boxVao);
+	return culler;
+}
+
+/**
+ * @brief Gets the query an object's draw should be conditional on.
+ * @param[in] culler Occlusion culler
+ * @param[in] object Index of the scene object
+ * @return Query issued for the object on the previous frame, 0 if there is none and the object should be drawn
+ */
+inline GLuint GetOcclusionQuery(const OcclusionCuller& culler, int object)
+{
+	// Results older than the previous frame describe a different view
+	return culler.queriedFrames[object] == culler.frame - 1 ? culler.queries[object] : 0;
+}
+
+/**
+ * @brief Counts the results of the last frame's queries the GPU has finished, without waiting
+ * for the others. Costs up to two query calls per object, so only call it for the debug readout.
+ * @param[in,out] culler Occlusion culler, whose counters are updated
+ */
+inline void ReadOcclusionResults(OcclusionCuller& culler)
+{
+	culler.tested = 0;
+	culler.occluded = 0;
+	for (int object : culler.queriedObjects)
+	{
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(culler.queries[object], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_TRUE)
+		{
+			GLuint anySamples = GL_FALSE;
+			glGetQueryObjectuiv(culler.queries[object], GL_QUERY_RESULT, &anySamples);
+			culler.tested++;
+			if (anySamples == GL_FALSE)
+			{
+				culler.occluded++;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Issues the queries of this frame, drawing the bounding boxes against the depth buffer.
+ * Call after the opaque draws, while their framebuffer is still bound.
+ * @param[in,out] culler Occlusion culler
+ * @param[in,out] state State cache
+ * @param[in] boxProgram OpenGL handle to the program drawing the boxes
+ * @param[in] boxMinLocation Location of the program's boxMin uniform
+ * @param[in] boxMaxLocation Location of the program's boxMax uniform
+ * @param[in] objects Objects to query, those that passed frustum culling
+ * @param[in] bounds World bounds of every object, indexed by object
+ * @param[in] cameraPos Position of the camera
+ */
+inline void IssueOcclusionQueries(OcclusionCuller& culler, GLStateCache& state, GLuint boxProgram, GLint boxMinLocation, GLint boxMaxLocation, const std::vector<int>& objects, const std::vector<Bounds>& bounds, const glm::vec3& cameraPos)
+{
+	culler.queriedObjects.clear();
+	UseProgram(state, boxProgram);
+	BindVertexArray(state, culler.boxVao);
+
+	// The boxes only test depth. Both sides of their faces are drawn, as every side is a conservative test.
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	for (int object : objects)
+	{
+		glm::vec3 boxMin = bounds[object].min - glm::vec3(OCCLUSION_BOX_MARGIN);
+		glm::vec3 boxMax = bounds[object].max + glm::vec3(OCCLUSION_BOX_MARGIN);
+
+		// From inside its box, an object may cover the whole view while the box shows nothing
+		if (cameraPos.x >= boxMin.x && cameraPos.y >= boxMin.y && cameraPos.z >= boxMin.z &&
+			cameraPos.x <= boxMax.x && cameraPos.y <= boxMax.y && cameraPos.z <= boxMax.z)
+		{
+			continue;
+		}
+
+		glUniform3fv(boxMinLocation, 1, &boxMin.x);
+		glUniform3fv(boxMaxLocation, 1, &boxMax.x);
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, culler.queries[object]);
+		glDrawArrays(GL_TRIANGLES, 0, 36);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		culler.queriedFrames[object] = culler.frame;
+		culler.queriedObjects.push_back(object);
+	}
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	culler.frame++;
+}
+
+/**
+ * @brief Deletes the queries.
+ * @param[in,out] culler Occlusion culler to delete
+ */
+inline void DeleteOcclusionCuller(OcclusionCuller& culler)
+{
+	if (!culler.queries.empty())
+	{
+		glDeleteQueries(static_cast<GLsizei>(culler.queries.size()), culler.queries.data());
+	}
+	glDeleteVertexArrays(1, &culler.boxVao);
+	culler = OcclusionCuller();
+}
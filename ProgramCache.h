@@ -0,0 +1,261 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+
+// ---------------
+// On-disk shader program cache
+// ---------------
+//
+// Linked programs are saved with glGetProgramBinary and restored with glProgramBinary
+// on later launches, which skips compiling and linking entirely. Each binary is stored in
+// its own file, named after a hash of the shader sources, the defines and the driver's
+// vendor, renderer and version strings, so editing a shader or updating the driver simply
+// misses the cache. A binary the driver rejects anyway is treated as a miss too.
+//
+// Program binaries are core in OpenGL 4.1 and available earlier through
+// GL_ARB_get_program_binary. The entry points are not part of the 3.3 loader, so they
+// are fetched from GLFW; without them, every program is compiled from source.
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP ProgramCacheGetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramCacheProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramCacheProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'R', 'G', 'B' };
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+/**
+ * Header at the start of a program cache file, followed by the binary itself
+ */
+struct ProgramCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t binaryFormat;
+	uint32_t length;
+};
+
+/**
+ * Struct containing the state of the program cache
+ */
+struct ProgramCache
+{
+	bool supported = false;
+	std::string directory = ".";
+	uint64_t driverHash = 0;	// Hash of the vendor, renderer and version strings
+
+	ProgramCacheGetProgramBinaryProc getProgramBinary = nullptr;
+	ProgramCacheProgramBinaryProc programBinary = nullptr;
+	ProgramCacheProgramParameteriProc programParameteri = nullptr;
+
+	int hits = 0;
+	int misses = 0;
+};
+
+/**
+ * @brief Gets a string of the OpenGL context, or an empty string if the driver returns none.
+ * @param[in] name GL_VENDOR, GL_RENDERER or GL_VERSION
+ * @return Value of the string
+ */
+inline std::string GetGLString(GLenum name)
+{
+	const GLubyte* value = glGetString(name);
+	return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+/**
+ * @brief Checks whether the context supports program binaries and loads their entry points.
+ * Call once after GLAD has been loaded.
+ * @param[out] cache Program cache to initialize
+ * @param[in] directory Directory the cache files are stored in, which must already exist
+ * @return True if programs can be cached, false if they will always be compiled from source
+ */
+inline bool InitProgramCache(ProgramCache& cache, const std::string& directory)
+{
+	cache = ProgramCache();
+	cache.directory = directory;
+	cache.driverHash = HashString(GetGLString(GL_VENDOR));
+	cache.driverHash = HashString(GetGLString(GL_RENDERER), cache.driverHash);
+	cache.driverHash = HashString(GetGLString(GL_VERSION), cache.driverHash);
+
+	bool core = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1);
+	if (!core && !glfwExtensionSupported("GL_ARB_get_program_binary"))
+	{
+		return false;
+	}
+
+	cache.getProgramBinary = reinterpret_cast<ProgramCacheGetProgramBinaryProc>(glfwGetProcAddress("glGetProgramBinary"));
+	cache.programBinary = reinterpret_cast<ProgramCacheProgramBinaryProc>(glfwGetProcAddress("glProgramBinary"));
+	cache.programParameteri = reinterpret_cast<ProgramCacheProgramParameteriProc>(glfwGetProcAddress("glProgramParameteri"));
+	if (!cache.getProgramBinary || !cache.programBinary || !cache.programParameteri)
+	{
+		return false;
+	}
+
+	// Some drivers expose the extension without supporting a single binary format
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	cache.supported = formatCount > 0;
+	return cache.supported;
+}
+
+/**
+ * @brief Computes the key of a program.
+ * @param[in] cache Program cache
+ * @param[in] sources Sources of every shader stage, in a fixed order
+ * @param[in] defines Preprocessor defines the program is compiled with
+ * @return Key of the program
+ */
+inline uint64_t GetProgramCacheKey(const ProgramCache& cache, const std::vector<std::string>& sources, const std::string& defines)
+{
+	uint64_t key = HashBytes(&cache.driverHash, sizeof(cache.driverHash));
+	key = HashString(defines, key);
+	for (const std::string& source : sources)
+	{
+		key = HashString(source, key);
+	}
+	return key;
+}
+
+/**
+ * @brief Gets the path of the cache file of a program.
+ * @param[in] cache Program cache
+ * @param[in] key Key returned by GetProgramCacheKey()
+ * @return Path to the cache file
+ */
+inline std::string GetProgramCachePath(const ProgramCache& cache, uint64_t key)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.progcache", static_cast<unsigned long long>(key));
+	return cache.directory + "/" + name;
+}
+
+/**
+ * @brief Marks a program, before it is linked, as one whose binary will be retrieved.
+ * Does nothing if the cache is not supported.
+ * @param[in] cache Program cache
+ * @param[in] program OpenGL handle to the shader program
+ */
+inline void PrepareProgramForCache(const ProgramCache& cache, GLuint program)
+{
+	if (cache.supported)
+	{
+		cache.programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+/**
+ * @brief Creates a program from its cached binary.
+ * @param[in,out] cache Program cache, whose hit and miss counters are updated
+ * @param[in] key Key returned by GetProgramCacheKey()
+ * @return OpenGL handle to the linked program, or 0 if the binary is missing or was rejected
+ */
+inline GLuint LoadCachedProgram(ProgramCache& cache, uint64_t key)
+{
+	if (!cache.supported)
+	{
+		return 0;
+	}
+
+	// Opened at the end to learn the file size, so a corrupt length is caught before allocating
+	std::ifstream file(GetProgramCachePath(cache, key), std::ios::binary | std::ios::ate);
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0);
+	ProgramCacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != PROGRAM_CACHE_VERSION ||
+		header.length > static_cast<uint64_t>(fileSize) - sizeof(header))
+	{
+		cache.misses++;
+		return 0;
+	}
+
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size()))
+	{
+		cache.misses++;
+		return 0;
+	}
+
+	// The driver may refuse a binary it produced itself, for example after an update
+	// that kept the version string, so the link status decides whether it was a hit
+	GLuint program = glCreateProgram();
+	cache.programBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint linkStatus = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+	if (linkStatus != GL_TRUE)
+	{
+		glDeleteProgram(program);
+		cache.misses++;
+		return 0;
+	}
+
+	cache.hits++;
+	return program;
+}
+
+/**
+ * @brief Saves the binary of a linked program. Does nothing if the cache is not supported.
+ * @param[in] cache Program cache
+ * @param[in] key Key returned by GetProgramCacheKey()
+ * @param[in] program OpenGL handle to the linked shader program
+ * @return True if the binary was written, false otherwise
+ */
+inline bool StoreProgramBinary(const ProgramCache& cache, uint64_t key, GLuint program)
+{
+	if (!cache.supported)
+	{
+		return false;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return false;
+	}
+
+	std::vector<char> binary(length);
+	GLenum binaryFormat = 0;
+	GLsizei written = 0;
+	cache.getProgramBinary(program, length, &written, &binaryFormat, binary.data());
+	if (written <= 0)
+	{
+		return false;
+	}
+
+	std::ofstream file(GetProgramCachePath(cache, key), std::ios::binary | std::ios::trunc);
+	if (file.fail())
+	{
+		return false;
+	}
+
+	ProgramCacheHeader header = {};
+	std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.binaryFormat = binaryFormat;
+	header.length = static_cast<uint32_t>(written);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(binary.data(), written);
+	return file.good();
+}
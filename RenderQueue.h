@@ -0,0 +1,256 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "GLState.h"
+#include "GpuTimers.h"
+#include "MaterialArray.h"
+#include "Mesh.h"
+#include "UniformBuffers.h"
+
+// ---------------
+// Sorted render queue
+// ---------------
+//
+// Every frame, each draw is submitted as a small packet with a 64-bit sort key. The queue
+// is radix sorted on the key and then executed, so draws sharing a program, texture and
+// vertex array end up next to each other, and opaque draws go front to back for early-Z.
+//
+// Key layout, from the most significant bit:
+//   63..60  pass
+//   59..52  program
+//   51..44  texture
+//   43..36  vertex array object
+//   35..12  quantized view depth (inverted for transparent draws, so they go back to front)
+//   11..0   unused
+
+/**
+ * Passes of the render queue, in the order they are drawn
+ */
+enum RenderPass : uint32_t
+{
+	RENDER_PASS_DEPTH = 0,			// Depth only, so the opaque pass shades each pixel once
+	RENDER_PASS_OPAQUE = 1,
+	RENDER_PASS_TRANSPARENT = 2
+};
+
+const int SORT_KEY_DEPTH_BITS = 24;
+
+/**
+ * Struct containing everything needed to issue one draw call
+ */
+struct DrawPacket
+{
+	uint64_t key = 0;
+	GLuint program = 0;
+	GLint positionOffsetLocation = -1;	// Dequantization uniforms of the program, see SetMeshDequantization()
+	GLint positionScaleLocation = -1;
+	GLuint vao = 0;
+	GLuint texture = 0;				// Bound as GL_TEXTURE_2D_ARRAY to MATERIAL_TEXTURE_UNIT
+	const Mesh* mesh = nullptr;
+	MeshRange range;
+	GLsizei instanceCount = 0;		// 0 for a regular draw
+	GLsizeiptr objectBlock = -1;	// Slot of the per-object block, -1 if the draw does not use one
+	int timerScope = -1;			// GPU timer scope of the draw's group, -1 for none
+	GLuint occlusionQuery = 0;		// Query the draw is conditional on, 0 to always draw, see OcclusionCulling.h
+};
+
+/**
+ * Struct containing a sort key and the packet it belongs to
+ */
+struct SortEntry
+{
+	uint64_t key;
+	uint32_t packet;
+};
+
+/**
+ * Struct containing the draws submitted for one frame
+ */
+struct RenderQueue
+{
+	std::vector<DrawPacket> packets;
+
+	// Sorted order of the packets, and the scratch buffer of the radix sort
+	std::vector<SortEntry> order;
+	std::vector<SortEntry> scratch;
+};
+
+/**
+ * @brief Packs the sort key of a draw.
+ * Handles only keep their low 8 bits, which is plenty to group draws of the small number of programs and textures in use.
+ * @param[in] pass Pass the draw belongs to
+ * @param[in] program OpenGL handle to the shader program
+ * @param[in] texture OpenGL handle to the texture
+ * @param[in] vao OpenGL handle to the vertex array object
+ * @param[in] depth Distance from the camera along the view direction
+ * @param[in] farPlane Distance of the far plane, depths beyond it are clamped
+ * @return Sort key of the draw
+ */
+inline uint64_t MakeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint vao, float depth, float farPlane)
+{
+	const uint32_t depthMax = (1u << SORT_KEY_DEPTH_BITS) - 1;
+	float normalizedDepth = std::min(std::max(depth / farPlane, 0.0f), 1.0f);
+	uint64_t quantizedDepth = static_cast<uint64_t>(normalizedDepth * depthMax);
+	if (pass == RENDER_PASS_TRANSPARENT)
+	{
+		quantizedDepth = depthMax - quantizedDepth;
+	}
+
+	return (static_cast<uint64_t>(pass & 0xF) << 60) |
+		(static_cast<uint64_t>(program & 0xFF) << 52) |
+		(static_cast<uint64_t>(texture & 0xFF) << 44) |
+		(static_cast<uint64_t>(vao & 0xFF) << 36) |
+		(quantizedDepth << 12);
+}
+
+/**
+ * @brief Empties the queue, keeping its memory for the next frame.
+ * @param[in,out] queue Render queue to clear
+ */
+inline void ClearRenderQueue(RenderQueue& queue)
+{
+	queue.packets.clear();
+}
+
+/**
+ * @brief Adds a draw to the queue.
+ * @param[in,out] queue Render queue
+ * @param[in] packet Draw to add, with its sort key
+ */
+inline void SubmitDraw(RenderQueue& queue, const DrawPacket& packet)
+{
+	queue.packets.push_back(packet);
+}
+
+/**
+ * @brief Sorts the submitted draws by key with an LSD radix sort, one byte per pass.
+ * Passes over bytes that are equal in every key are skipped, so unused key bits cost nothing.
+ * The sort is stable, so draws with equal keys keep their submission order.
+ * @param[in,out] queue Render queue to sort
+ */
+inline void SortRenderQueue(RenderQueue& queue)
+{
+	size_t count = queue.packets.size();
+	queue.order.resize(count);
+	queue.scratch.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		queue.order[i].key = queue.packets[i].key;
+		queue.order[i].packet = static_cast<uint32_t>(i);
+	}
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = {};
+		for (const SortEntry& entry : queue.order)
+		{
+			histogram[(entry.key >> shift) & 0xFF]++;
+		}
+		if (count == 0 || histogram[(queue.order[0].key >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		// Turn the histogram into the first output slot of every byte value
+		size_t offset = 0;
+		for (size_t& bucket : histogram)
+		{
+			size_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (const SortEntry& entry : queue.order)
+		{
+			queue.scratch[histogram[(entry.key >> shift) & 0xFF]++] = entry;
+		}
+		queue.order.swap(queue.scratch);
+	}
+}
+
+/**
+ * @brief Issues the draws of a sorted queue. State changes go through the state cache,
+ * so consecutive draws sharing state only pay for the draw call itself.
+ * Depth pass draws write no color. After them, the other passes test depth with GL_LEQUAL
+ * so the surfaces already in the depth buffer pass.
+ * Each run of draws sharing a timer scope is timed by that scope. When other draws sort
+ * between the draws of a group, the scope adds up the time of all its runs.
+ * @param[in] queue Sorted render queue
+ * @param[in,out] state State cache
+ * @param[in] buffers Uniform buffers owning the per-object blocks
+ * @param[in,out] timers GPU timers owning the scopes of the draws
+ */
+inline void ExecuteRenderQueue(const RenderQueue& queue, GLStateCache& state, const UniformBuffers& buffers, GpuTimers& timers)
+{
+	int currentScope = -1;
+	GLuint dequantizedProgram = 0;
+	const Mesh* dequantizedMesh = nullptr;
+	bool depthPass = false;
+	bool depthPassDrawn = false;
+	for (const SortEntry& entry : queue.order)
+	{
+		const DrawPacket& packet = queue.packets[entry.packet];
+
+		// Depth pass draws sort first, so the pass only starts and ends once
+		bool depthOnly = (entry.key >> 60) == RENDER_PASS_DEPTH;
+		if (depthOnly != depthPass)
+		{
+			GLboolean writeColor = depthOnly ? GL_FALSE : GL_TRUE;
+			glColorMask(writeColor, writeColor, writeColor, writeColor);
+			glDepthFunc(depthOnly ? GL_LESS : GL_LEQUAL);
+			depthPass = depthOnly;
+			depthPassDrawn = true;
+		}
+
+		if (packet.timerScope != currentScope)
+		{
+			EndGpuScope(timers, currentScope);
+			BeginGpuScope(timers, packet.timerScope);
+			currentScope = packet.timerScope;
+		}
+
+		UseProgram(state, packet.program);
+		BindVertexArray(state, packet.vao);
+		if (packet.program != dequantizedProgram || packet.mesh != dequantizedMesh)
+		{
+			SetMeshDequantization(packet.positionOffsetLocation, packet.positionScaleLocation, *packet.mesh);
+			dequantizedProgram = packet.program;
+			dequantizedMesh = packet.mesh;
+		}
+		BindTexture(state, MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, packet.texture);
+		if (packet.objectBlock >= 0)
+		{
+			BindObjectBlock(state, buffers, packet.objectBlock);
+		}
+
+		// Without waiting for the query, the GPU draws anyway if the result is not there yet
+		if (packet.occlusionQuery != 0)
+		{
+			glBeginConditionalRender(packet.occlusionQuery, GL_QUERY_BY_REGION_NO_WAIT);
+		}
+		if (packet.instanceCount > 0)
+		{
+			DrawMeshRangeInstanced(*packet.mesh, packet.range, packet.instanceCount);
+		}
+		else
+		{
+			DrawMeshRange(*packet.mesh, packet.range);
+		}
+		if (packet.occlusionQuery != 0)
+		{
+			glEndConditionalRender();
+		}
+	}
+	EndGpuScope(timers, currentScope);
+
+	if (depthPassDrawn)
+	{
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
+}
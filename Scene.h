@@ -0,0 +1,400 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "Vertex.h"
+
+// ---------------
+// Binary scene files
+// ---------------
+//
+// A scene file is a header followed by five chunks: vertices, 16-bit indices, objects,
+// texture paths and lights. Every chunk starts at a 16-byte aligned offset and is stored
+// exactly as the renderer uses it, so a mapped file is used in place without any parsing.
+
+const char SCENE_FILE_MAGIC[4] = { 'S', 'H', 'R', 'N' };
+const uint32_t SCENE_FILE_VERSION = 2;	// 2: material and kasagi object flags
+const uint64_t SCENE_CHUNK_ALIGNMENT = 16;
+
+/**
+ * Flags stored with each object of a scene file
+ */
+enum SceneObjectFlags : uint32_t
+{
+	SCENE_OBJECT_GATE_PART = 1 << 0,		// Part of a torii gate, drawn by the instanced path when enabled
+
+	// Material features the object goes without, see ShaderPermutations.h
+	SCENE_OBJECT_UNTEXTURED = 1 << 1,		// Shaded with its vertex color
+	SCENE_OBJECT_NO_SPECULAR = 1 << 2,
+	SCENE_OBJECT_NO_POINT_LIGHTS = 1 << 3,	// Only lit by the global light
+
+	SCENE_OBJECT_KASAGI = 1 << 4			// Top beam of a torii gate, drawn with the detail levels of LevelOfDetail.h
+};
+
+/**
+ * Number of parts in a torii gate (2 bases, 2 pillars, 2 horizontal beams and 2 roof wings).
+ * Scene files store the parts of each gate as that many consecutive objects, the left base first.
+ */
+const int TORII_GATE_PART_COUNT = 8;
+
+/**
+ * Types of the lights stored in a scene file
+ */
+enum SceneLightType : uint32_t
+{
+	SCENE_LIGHT_GLOBAL = 0,		// Light without attenuation (the orbiting global light)
+	SCENE_LIGHT_POINT = 1		// Attenuated point light (the candle)
+};
+
+/**
+ * Location of a chunk inside a scene file
+ */
+struct SceneChunk
+{
+	uint64_t offset;
+	uint64_t count;
+};
+
+/**
+ * Header at the start of a scene file
+ */
+struct SceneFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t vertexStride;	// Has to match sizeof(Vertex)
+	uint32_t indexSize;		// Has to match sizeof(GLushort)
+	SceneChunk vertices;
+	SceneChunk indices;
+	SceneChunk objects;
+	SceneChunk textures;
+	SceneChunk lights;
+};
+
+/**
+ * Object of a scene file: a range of the scene's indices drawn with one texture and model matrix
+ */
+struct SceneObjectRecord
+{
+	glm::mat4 model;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t textureIndex;
+	uint32_t flags;			// SceneObjectFlags
+};
+
+/**
+ * Texture of a scene file, referenced by path relative to the working directory
+ */
+struct SceneTextureRecord
+{
+	char path[64];
+};
+
+/**
+ * Light of a scene file. Mirrors the light parameters used by main.fsh.
+ */
+struct SceneLightRecord
+{
+	glm::vec3 position;		uint32_t type;			// SceneLightType
+	glm::vec3 ambient;		float constant;
+	glm::vec3 diffuse;		float linear;
+	glm::vec3 specular;		float quadratic;
+	glm::vec3 specComp;		float pad;
+};
+
+static_assert(sizeof(SceneFileHeader) == 96, "SceneFileHeader has to be tightly packed");
+static_assert(sizeof(SceneObjectRecord) == 80, "SceneObjectRecord has to be tightly packed");
+static_assert(sizeof(SceneLightRecord) == 80, "SceneLightRecord has to be tightly packed");
+
+/**
+ * Struct containing a scene loaded from a scene file. All pointers point into the mapped
+ * file, so they stay valid until UnloadScene() is called.
+ */
+struct Scene
+{
+	MappedFile file;
+
+	const Vertex* vertices = nullptr;
+	size_t vertexCount = 0;
+	const GLushort* indices = nullptr;
+	size_t indexCount = 0;
+	const SceneObjectRecord* objects = nullptr;
+	size_t objectCount = 0;
+	const SceneTextureRecord* textures = nullptr;
+	size_t textureCount = 0;
+	const SceneLightRecord* lights = nullptr;
+	size_t lightCount = 0;
+};
+
+/**
+ * Struct used to assemble a scene before writing it to a scene file
+ */
+struct SceneBuilder
+{
+	std::vector<Vertex> vertices;
+	std::vector<GLushort> indices;
+	std::vector<SceneObjectRecord> objects;
+	std::vector<SceneTextureRecord> textures;
+	std::vector<SceneLightRecord> lights;
+};
+
+/**
+ * @brief Gets the range of scene indices drawn by an object.
+ * @param[in] object Object of the scene
+ * @return Range of indices of the object
+ */
+inline MeshRange GetObjectRange(const SceneObjectRecord& object)
+{
+	MeshRange range;
+	range.firstIndex = static_cast<GLsizei>(object.firstIndex);
+	range.indexCount = static_cast<GLsizei>(object.indexCount);
+	return range;
+}
+
+/**
+ * @brief Adds a texture to a scene being built.
+ * @param[in,out] builder Scene being built
+ * @param[in] path Path to the image file
+ * @return Index of the texture, to be referenced by objects
+ */
+inline uint32_t AddSceneTexture(SceneBuilder& builder, const std::string& path)
+{
+	SceneTextureRecord texture = {};
+	std::strncpy(texture.path, path.c_str(), sizeof(texture.path) - 1);
+	builder.textures.push_back(texture);
+	return static_cast<uint32_t>(builder.textures.size() - 1);
+}
+
+/**
+ * @brief Adds an object to a scene being built.
+ * @param[in,out] builder Scene being built
+ * @param[in] model Model matrix of the object
+ * @param[in] range Range of the scene's indices drawn by the object
+ * @param[in] textureIndex Index of the object's texture
+ * @param[in] flags Combination of SceneObjectFlags
+ */
+inline void AddSceneObject(SceneBuilder& builder, const glm::mat4& model, const MeshRange& range, uint32_t textureIndex, uint32_t flags)
+{
+	SceneObjectRecord object;
+	object.model = model;
+	object.firstIndex = static_cast<uint32_t>(range.firstIndex);
+	object.indexCount = static_cast<uint32_t>(range.indexCount);
+	object.textureIndex = textureIndex;
+	object.flags = flags;
+	builder.objects.push_back(object);
+}
+
+/**
+ * @brief Writes a chunk to a scene file, padding the file so the chunk starts at an aligned offset.
+ * @param[in,out] file Output file stream
+ * @param[in] data Pointer to the chunk data
+ * @param[in] elementSize Size of one element in bytes
+ * @param[in] count Number of elements
+ * @return Location of the chunk inside the file
+ */
+inline SceneChunk WriteSceneChunk(std::ofstream& file, const void* data, size_t elementSize, size_t count)
+{
+	uint64_t position = static_cast<uint64_t>(file.tellp());
+	uint64_t aligned = (position + SCENE_CHUNK_ALIGNMENT - 1) / SCENE_CHUNK_ALIGNMENT * SCENE_CHUNK_ALIGNMENT;
+	const char padding[SCENE_CHUNK_ALIGNMENT] = {};
+	file.write(padding, static_cast<std::streamsize>(aligned - position));
+
+	SceneChunk chunk;
+	chunk.offset = aligned;
+	chunk.count = count;
+	if (count > 0)
+	{
+		file.write(static_cast<const char*>(data), static_cast<std::streamsize>(elementSize * count));
+	}
+	return chunk;
+}
+
+/**
+ * @brief Writes a scene to a scene file.
+ * @param[in] filePath Path to the scene file
+ * @param[in] builder Scene to write
+ * @return True if the file was written, false otherwise
+ */
+inline bool WriteSceneFile(const std::string& filePath, const SceneBuilder& builder)
+{
+	std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+	if (file.fail())
+	{
+		std::cerr << "Unable to write scene file: " << filePath << std::endl;
+		return false;
+	}
+
+	// Reserve space for the header, which is filled in once the chunk offsets are known
+	SceneFileHeader header = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+	header.version = SCENE_FILE_VERSION;
+	header.vertexStride = sizeof(Vertex);
+	header.indexSize = sizeof(GLushort);
+	header.vertices = WriteSceneChunk(file, builder.vertices.data(), sizeof(Vertex), builder.vertices.size());
+	header.indices = WriteSceneChunk(file, builder.indices.data(), sizeof(GLushort), builder.indices.size());
+	header.objects = WriteSceneChunk(file, builder.objects.data(), sizeof(SceneObjectRecord), builder.objects.size());
+	header.textures = WriteSceneChunk(file, builder.textures.data(), sizeof(SceneTextureRecord), builder.textures.size());
+	header.lights = WriteSceneChunk(file, builder.lights.data(), sizeof(SceneLightRecord), builder.lights.size());
+
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	return !file.fail();
+}
+
+/**
+ * @brief Checks that a chunk lies inside the mapped file and is aligned.
+ * @param[in] chunk Chunk to check
+ * @param[in] elementSize Size of one element in bytes
+ * @param[in] fileSize Size of the file in bytes
+ * @return True if the chunk can be read in place, false otherwise
+ */
+inline bool IsSceneChunkValid(const SceneChunk& chunk, size_t elementSize, size_t fileSize)
+{
+	if (chunk.offset % SCENE_CHUNK_ALIGNMENT != 0 || chunk.offset > fileSize)
+	{
+		return false;
+	}
+	return chunk.count <= (fileSize - chunk.offset) / elementSize;
+}
+
+/**
+ * @brief Checks whether a file is a scene file written with another version of the format.
+ * @param[in] filePath Path to the scene file
+ * @return True if the file is a scene file of another version, false otherwise
+ */
+inline bool IsSceneFileOutdated(const std::string& filePath)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	SceneFileHeader header;
+	return file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+		std::memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+		header.version != SCENE_FILE_VERSION;
+}
+
+/**
+ * @brief Unloads a scene loaded with LoadScene().
+ * @param[in,out] scene Scene to unload
+ */
+inline void UnloadScene(Scene& scene)
+{
+	UnmapFile(scene.file);
+	scene = Scene();
+}
+
+/**
+ * @brief Loads a scene file by mapping it into memory. The header, the chunk locations and
+ * every reference between records are validated; the chunks are then used in place.
+ * @param[in] filePath Path to the scene file
+ * @param[out] scene Loaded scene on success
+ * @return True if the scene was loaded, false otherwise
+ */
+inline bool LoadScene(const std::string& filePath, Scene& scene)
+{
+	UnloadScene(scene);
+
+	if (!MapFile(filePath, scene.file))
+	{
+		return false;
+	}
+
+	const SceneFileHeader* header = reinterpret_cast<const SceneFileHeader*>(scene.file.data);
+	size_t fileSize = scene.file.size;
+	if (fileSize < sizeof(SceneFileHeader) ||
+		std::memcmp(header->magic, SCENE_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != SCENE_FILE_VERSION ||
+		header->vertexStride != sizeof(Vertex) ||
+		header->indexSize != sizeof(GLushort))
+	{
+		std::cerr << "Unsupported scene file: " << filePath << std::endl;
+		UnloadScene(scene);
+		return false;
+	}
+
+	if (!IsSceneChunkValid(header->vertices, sizeof(Vertex), fileSize) ||
+		!IsSceneChunkValid(header->indices, sizeof(GLushort), fileSize) ||
+		!IsSceneChunkValid(header->objects, sizeof(SceneObjectRecord), fileSize) ||
+		!IsSceneChunkValid(header->textures, sizeof(SceneTextureRecord), fileSize) ||
+		!IsSceneChunkValid(header->lights, sizeof(SceneLightRecord), fileSize))
+	{
+		std::cerr << "Corrupted scene file: " << filePath << std::endl;
+		UnloadScene(scene);
+		return false;
+	}
+
+	const unsigned char* base = scene.file.data;
+	scene.vertices = reinterpret_cast<const Vertex*>(base + header->vertices.offset);
+	scene.vertexCount = static_cast<size_t>(header->vertices.count);
+	scene.indices = reinterpret_cast<const GLushort*>(base + header->indices.offset);
+	scene.indexCount = static_cast<size_t>(header->indices.count);
+	scene.objects = reinterpret_cast<const SceneObjectRecord*>(base + header->objects.offset);
+	scene.objectCount = static_cast<size_t>(header->objects.count);
+	scene.textures = reinterpret_cast<const SceneTextureRecord*>(base + header->textures.offset);
+	scene.textureCount = static_cast<size_t>(header->textures.count);
+	scene.lights = reinterpret_cast<const SceneLightRecord*>(base + header->lights.offset);
+	scene.lightCount = static_cast<size_t>(header->lights.count);
+
+	// Texture paths are turned into strings, so each has to end inside its record
+	for (size_t i = 0; i < scene.textureCount; i++)
+	{
+		const SceneTextureRecord& texture = scene.textures[i];
+		if (std::memchr(texture.path, '\0', sizeof(texture.path)) == nullptr)
+		{
+			std::cerr << "Scene texture " << i << " has an unterminated path in: " << filePath << std::endl;
+			UnloadScene(scene);
+			return false;
+		}
+	}
+
+	// Objects are trusted to stay inside the index chunk, to only reference existing vertices
+	// and textures, only after this check. Their vertices are read on the CPU for the bounds.
+	for (size_t i = 0; i < scene.objectCount; i++)
+	{
+		const SceneObjectRecord& object = scene.objects[i];
+		bool valid = static_cast<uint64_t>(object.firstIndex) + object.indexCount <= scene.indexCount &&
+			object.textureIndex < scene.textureCount;
+		for (uint32_t j = 0; valid && j < object.indexCount; j++)
+		{
+			valid = scene.indices[object.firstIndex + j] < scene.vertexCount;
+		}
+		if (!valid)
+		{
+			std::cerr << "Scene object " << i << " is out of range in: " << filePath << std::endl;
+			UnloadScene(scene);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief Finds the first light of a given type in a scene.
+ * @param[in] scene Scene to search
+ * @param[in] type Type of light to find
+ * @return Pointer to the light, or nullptr if the scene has no light of that type
+ */
+inline const SceneLightRecord* FindSceneLight(const Scene& scene, SceneLightType type)
+{
+	for (size_t i = 0; i < scene.lightCount; i++)
+	{
+		if (scene.lights[i].type == type)
+		{
+			return &scene.lights[i];
+		}
+	}
+	return nullptr;
+}
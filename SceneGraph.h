@@ -0,0 +1,201 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "FrustumCulling.h"
+#include "Scene.h"
+#include "TransformBatch.h"
+
+// ---------------
+// Scene graph
+// ---------------
+//
+// Nodes hold a transform relative to their parent and cache their world transform. Nodes
+// are stored depth first, every parent before its children and every subtree contiguous,
+// so updating a node and everything below it is a single forward loop over a range.
+// Changing a node only records it as dirty; the next update recomputes the dirty subtrees
+// and hands their objects' new world matrices to the transform batch, which caches the
+// normal matrices, and their world bounds to the culling hierarchy. A frame in which nothing
+// moved costs nothing.
+
+/**
+ * Struct containing one node of the scene graph
+ */
+struct SceneNode
+{
+	int parent = -1;			// -1 for the root
+	int subtreeEnd = 0;			// One past the last node of the subtree
+	int object = -1;			// Scene object drawn with this node's transform, -1 for none
+	GLint layer = 0;			// Layer of the material array of the object
+	Bounds bounds;				// Bounds of the object in model space
+	glm::mat4 local = glm::mat4(1.0f);
+	glm::mat4 world = glm::mat4(1.0f);
+};
+
+/**
+ * Struct containing the nodes of a scene
+ */
+struct SceneGraph
+{
+	std::vector<SceneNode> nodes;	// Depth first, see above
+	std::vector<int> objectNodes;	// Node of each scene object
+	std::vector<Bounds> objectBounds;	// World bounds of each scene object
+	std::vector<int> dirtyNodes;	// Nodes whose local transform changed since the last update
+	int updatedNodes = 0;			// Nodes recomputed by the last update
+};
+
+/**
+ * @brief Adds a node. Nodes have to be added depth first: a node's parent must be the
+ * last node added or one of its ancestors.
+ * @param[in,out] graph Scene graph
+ * @param[in] parent Index of the parent node, -1 for a root
+ * @param[in] local Transform relative to the parent
+ * @param[in] object Scene object drawn with the node's transform, -1 for none
+ * @param[in] layer Layer of the material array of the object
+ * @param[in] bounds Bounds of the object in model space
+ * @return Index of the node
+ */
+inline int AddSceneNode(SceneGraph& graph, int parent, const glm::mat4& local, int object = -1, GLint layer = 0, const Bounds& bounds = Bounds())
+{
+	int index = static_cast<int>(graph.nodes.size());
+
+	SceneNode node;
+	node.parent = parent;
+	node.subtreeEnd = index + 1;
+	node.object = object;
+	node.layer = layer;
+	node.bounds = bounds;
+	node.local = local;
+	graph.nodes.push_back(node);
+
+	// The new node extends the subtree of every ancestor
+	for (int ancestor = parent; ancestor >= 0; ancestor = graph.nodes[ancestor].parent)
+	{
+		graph.nodes[ancestor].subtreeEnd = index + 1;
+	}
+
+	if (object >= 0)
+	{
+		if (graph.objectNodes.size() <= static_cast<size_t>(object))
+		{
+			graph.objectNodes.resize(object + 1, -1);
+			graph.objectBounds.resize(object + 1);
+		}
+		graph.objectNodes[object] = index;
+	}
+
+	// New nodes have no world transform yet
+	graph.dirtyNodes.push_back(index);
+	return index;
+}
+
+/**
+ * @brief Changes the transform of a node relative to its parent. The node and its subtree
+ * are recomputed on the next update.
+ * @param[in,out] graph Scene graph
+ * @param[in] node Index of the node
+ * @param[in] local New transform relative to the parent
+ */
+inline void SetSceneNodeTransform(SceneGraph& graph, int node, const glm::mat4& local)
+{
+	graph.nodes[node].local = local;
+	graph.dirtyNodes.push_back(node);
+}
+
+/**
+ * @brief Recomputes the world transforms of the dirty subtrees, passes the ones of their
+ * objects to the transform batch and moves their bounds to world space.
+ * Refit the culling hierarchy afterwards if any node was updated.
+ * @param[in,out] graph Scene graph
+ * @param[in,out] batch Transform batch holding one entry per scene object
+ */
+inline void UpdateSceneGraph(SceneGraph& graph, TransformBatch& batch)
+{
+	graph.updatedNodes = 0;
+	if (graph.dirtyNodes.empty())
+	{
+		return;
+	}
+
+	// Sorted, a dirty node inside a subtree already recomputed is skipped
+	std::sort(graph.dirtyNodes.begin(), graph.dirtyNodes.end());
+	int updatedEnd = 0;
+	for (int dirty : graph.dirtyNodes)
+	{
+		if (dirty < updatedEnd)
+		{
+			continue;
+		}
+
+		updatedEnd = graph.nodes[dirty].subtreeEnd;
+		for (int i = dirty; i < updatedEnd; i++)
+		{
+			SceneNode& node = graph.nodes[i];
+			node.world = node.parent < 0 ? node.local : graph.nodes[node.parent].world * node.local;
+			if (node.object >= 0)
+			{
+				SetBatchTransform(batch, static_cast<size_t>(node.object), node.world, node.layer);
+				graph.objectBounds[node.object] = TransformBounds(node.bounds, node.world);
+			}
+		}
+		graph.updatedNodes += updatedEnd - dirty;
+	}
+	graph.dirtyNodes.clear();
+}
+
+/**
+ * @brief Builds the graph of a loaded scene. Scene files store world transforms, so every
+ * object becomes a node under the root, except the gate parts. Each run of TORII_GATE_PART_COUNT
+ * parts becomes a gate node placed where its first part (the left base) is, with the parts
+ * under it in gate-local space, so a gate moves as a whole. The bounds of each object are
+ * computed from its vertices.
+ * @param[in] scene Loaded scene
+ * @return Scene graph with one node per scene object
+ */
+inline SceneGraph BuildSceneGraph(const Scene& scene)
+{
+	SceneGraph graph;
+	graph.objectNodes.assign(scene.objectCount, -1);
+	graph.objectBounds.resize(scene.objectCount);
+	int root = AddSceneNode(graph, -1, glm::mat4(1.0f));
+
+	// Any other object in between also ends the current gate
+	int gate = -1;
+	int gatePartCount = 0;
+	glm::mat4 toGate(1.0f);
+	for (size_t i = 0; i < scene.objectCount; i++)
+	{
+		const SceneObjectRecord& object = scene.objects[i];
+		if (!(object.flags & SCENE_OBJECT_GATE_PART))
+		{
+			gate = -1;
+			continue;
+		}
+
+		if (gate < 0 || gatePartCount == TORII_GATE_PART_COUNT)
+		{
+			gate = AddSceneNode(graph, root, object.model);
+			gatePartCount = 0;
+			toGate = glm::inverse(object.model);
+		}
+		AddSceneNode(graph, gate, toGate * object.model, static_cast<int>(i), static_cast<GLint>(object.textureIndex),
+			GetRangeBounds(scene.vertices, scene.indices, GetObjectRange(object)));
+		gatePartCount++;
+	}
+
+	for (size_t i = 0; i < scene.objectCount; i++)
+	{
+		const SceneObjectRecord& object = scene.objects[i];
+		if (!(object.flags & SCENE_OBJECT_GATE_PART))
+		{
+			AddSceneNode(graph, root, object.model, static_cast<int>(i), static_cast<GLint>(object.textureIndex),
+				GetRangeBounds(scene.vertices, scene.indices, GetObjectRange(object)));
+		}
+	}
+
+	return graph;
+}
@@ -0,0 +1,698 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "GLState.h"
+#include "MappedFile.h"
+#include "ProgramCache.h"
+#include "UniformBuffers.h"
+
+// ---------------
+// Shader sources and hot reload
+// ---------------
+//
+// Shader files are read in one go from a mapping, and `#include "file"` lines are replaced
+// by the file they name, relative to the including file. Every file a program was built
+// from is watched (through inotify on Linux, by polling modification times elsewhere), and
+// when one changes the program is rebuilt in the background: its shaders are compiled and
+// linked without querying the result, which with GL_KHR_parallel_shader_compile happens on
+// the driver's threads, and the new program only replaces the old one once it linked
+// successfully. A shader with errors leaves the running program untouched.
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP ShaderLibraryMaxCompilerThreadsProc)(GLuint count);
+
+const int SHADER_INCLUDE_MAX_DEPTH = 16;
+const double SHADER_POLL_INTERVAL = 0.5;	// Seconds between modification time checks, without inotify
+
+/**
+ * Locations of the plain uniforms set while drawing, resolved once per link so the render
+ * loop never looks a uniform up by name. -1 for the uniforms a program does not use.
+ */
+struct ShaderUniformLocations
+{
+	GLint boxMin = -1;			// Occlusion box, see IssueOcclusionQueries()
+	GLint boxMax = -1;
+	GLint positionOffset = -1;	// Packed position dequantization, see SetMeshDequantization()
+	GLint positionScale = -1;
+};
+
+/**
+ * @brief Resolves the locations of the plain uniforms of a linked program.
+ * @param[in] program OpenGL handle to the linked shader program
+ * @return Locations of the uniforms
+ */
+inline ShaderUniformLocations GetShaderUniformLocations(GLuint program)
+{
+	ShaderUniformLocations uniforms;
+	uniforms.boxMin = glGetUniformLocation(program, "boxMin");
+	uniforms.boxMax = glGetUniformLocation(program, "boxMax");
+	uniforms.positionOffset = glGetUniformLocation(program, "positionOffset");
+	uniforms.positionScale = glGetUniformLocation(program, "positionScale");
+	return uniforms;
+}
+
+/**
+ * Struct containing a program built from a vertex and a fragment shader file
+ */
+struct ShaderProgram
+{
+	std::string vertexPath;
+	std::string fragmentPath;
+	std::string defines;				// #define lines inserted after the #version line
+	GLuint program = 0;
+	ShaderUniformLocations uniforms;	// Of program, updated on reload
+	std::vector<std::string> files;		// Every file the program was built from, includes too
+
+	// Rebuild waiting for the driver to finish linking
+	GLuint pendingProgram = 0;
+	GLuint pendingShaders[2] = {};
+	std::vector<std::string> pendingFiles;
+	uint64_t pendingKey = 0;
+	bool dirty = false;					// A file changed since the last rebuild started
+};
+
+/**
+ * Struct containing a watched file and its last known modification time, used without inotify
+ */
+struct ShaderFileStamp
+{
+	std::string path;
+	std::filesystem::file_time_type time;
+};
+
+/**
+ * Struct containing every program built through the library
+ */
+struct ShaderLibrary
+{
+	std::vector<ShaderProgram> programs;
+	ProgramCache* cache = nullptr;
+
+	bool watching = false;
+	int inotifyFd = -1;
+	std::vector<std::string> watchedDirectories;
+	std::vector<int> watchDescriptors;		// inotify watch of each directory in watchedDirectories
+	std::vector<ShaderFileStamp> stamps;
+	double lastPoll = 0.0;
+
+	bool parallelCompile = false;	// GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile
+	int reloadCount = 0;
+};
+
+/**
+ * @brief Gets the directory part of a path.
+ * @param[in] path Path to a file
+ * @return Directory of the file, "." if the path has none
+ */
+inline std::string GetShaderDirectory(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+/**
+ * @brief Joins a directory and a file name, the inverse of GetShaderDirectory().
+ * @param[in] directory Directory
+ * @param[in] name Name of the file inside the directory
+ * @return Path to the file
+ */
+inline std::string JoinShaderPath(const std::string& directory, const std::string& name)
+{
+	return directory == "." ? name : directory + "/" + name;
+}
+
+/**
+ * @brief Reads a shader file in one go and replaces its `#include "file"` lines by the files they name.
+ * `#line` directives keep compiler messages pointing at the right line, with the index of the
+ * file in files as the source string number.
+ * @param[in] filePath Path to the shader file
+ * @param[out] source Shader source with every include resolved
+ * @param[in,out] files Every file read so far, filePath and its includes are appended
+ * @param[in] depth Nesting depth of the include, 0 for the shader itself
+ * @return True if the file and all its includes could be read, false otherwise
+ */
+inline bool LoadShaderSource(const std::string& filePath, std::string& source, std::vector<std::string>& files, int depth = 0)
+{
+	if (depth > SHADER_INCLUDE_MAX_DEPTH)
+	{
+		std::cerr << "Shader includes nested too deeply: " << filePath << std::endl;
+		return false;
+	}
+
+	MappedFile file;
+	if (!MapFile(filePath, file))
+	{
+		std::cerr << "Unable to open shader file: " << filePath << std::endl;
+		return false;
+	}
+	std::string text(reinterpret_cast<const char*>(file.data), file.size);
+	UnmapFile(file);
+
+	int fileIndex = static_cast<int>(files.size());
+	files.push_back(filePath);
+	source.reserve(source.size() + text.size());
+
+	size_t lineStart = 0;
+	int lineNumber = 1;
+	while (lineStart < text.size())
+	{
+		size_t lineEnd = text.find('\n', lineStart);
+		if (lineEnd == std::string::npos)
+		{
+			lineEnd = text.size();
+		}
+
+		size_t directive = text.find_first_not_of(" \t", lineStart);
+		if (directive < lineEnd && text.compare(directive, 8, "#include") == 0)
+		{
+			size_t open = text.find('"', directive);
+			size_t close = open < lineEnd ? text.find('"', open + 1) : std::string::npos;
+			if (close >= lineEnd)
+			{
+				std::cerr << filePath << ":" << lineNumber << ": malformed #include" << std::endl;
+				return false;
+			}
+
+			std::string includePath = JoinShaderPath(GetShaderDirectory(filePath), text.substr(open + 1, close - open - 1));
+			source += "#line 1 " + std::to_string(files.size()) + "\n";
+			if (!LoadShaderSource(includePath, source, files, depth + 1))
+			{
+				return false;
+			}
+			source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+		}
+		else
+		{
+			source.append(text, lineStart, lineEnd - lineStart);
+			source += '\n';
+		}
+
+		lineStart = lineEnd + 1;
+		lineNumber++;
+	}
+	return true;
+}
+
+/**
+ * @brief Creates a shader based on the provided shader type and the string containing the shader source.
+ * @param[in] shaderType Shader type
+ * @param[in] shaderSource Shader source string
+ * @param[in] checkStatus Whether to wait for the compiler and report errors. Rebuilds skip it,
+ * so the compile can run in the background, and find errors through the link status instead.
+ * @return OpenGL handle to the created shader
+ */
+inline GLuint CreateShaderFromSource(GLenum shaderType, const std::string& shaderSource, bool checkStatus = true)
+{
+	GLuint shader = glCreateShader(shaderType);
+
+	const char* shaderSourceCStr = shaderSource.c_str();
+	GLint shaderSourceLen = static_cast<GLint>(shaderSource.length());
+	glShaderSource(shader, 1, &shaderSourceCStr, &shaderSourceLen);
+	glCompileShader(shader);
+
+	if (!checkStatus)
+	{
+		return shader;
+	}
+
+	// Check compilation status
+	GLint compileStatus;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus);
+	if (compileStatus == GL_FALSE)
+	{
+		char infoLog[512];
+		GLsizei infoLogLen = sizeof(infoLog);
+		glGetShaderInfoLog(shader, infoLogLen, &infoLogLen, infoLog);
+		std::cerr << "shader compilation error: " << infoLog << std::endl;
+	}
+
+	return shader;
+}
+
+/**
+ * @brief Prints the info logs of a program that failed to link and of its shaders.
+ * @param[in] program OpenGL handle to the shader program
+ * @param[in] shaders OpenGL handles to the shaders attached to the program
+ * @param[in] shaderCount Number of shaders
+ */
+inline void PrintProgramErrors(GLuint program, const GLuint* shaders, int shaderCount)
+{
+	char infoLog[512];
+	for (int i = 0; i < shaderCount; i++)
+	{
+		GLint compileStatus;
+		glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compileStatus);
+		if (compileStatus == GL_FALSE)
+		{
+			GLsizei infoLogLen = sizeof(infoLog);
+			glGetShaderInfoLog(shaders[i], infoLogLen, &infoLogLen, infoLog);
+			std::cerr << "shader compilation error: " << infoLog << std::endl;
+		}
+	}
+
+	GLsizei infoLogLen = sizeof(infoLog);
+	glGetProgramInfoLog(program, infoLogLen, &infoLogLen, infoLog);
+	std::cerr << "program link error: " << infoLog << std::endl;
+}
+
+/**
+ * @brief Inserts preprocessor defines right after the #version line of a shader, which has to stay first.
+ * A `#line` directive follows them, so compiler messages keep pointing at the right line.
+ * @param[in,out] source Shader source with its includes resolved
+ * @param[in] defines #define lines, each ending with a newline. Nothing is inserted if empty.
+ */
+inline void InsertShaderDefines(std::string& source, const std::string& defines)
+{
+	if (defines.empty())
+	{
+		return;
+	}
+
+	size_t version = source.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+	if (lineEnd == std::string::npos)
+	{
+		source.insert(0, defines + "#line 1\n");
+		return;
+	}
+
+	// Count the lines up to and including #version to resume numbering after it
+	int line = static_cast<int>(std::count(source.begin(), source.begin() + lineEnd, '\n')) + 2;
+	source.insert(lineEnd + 1, defines + "#line " + std::to_string(line) + "\n");
+}
+
+/**
+ * @brief Creates a shader program from vertex and fragment shader sources.
+ * The linked program is restored from the program cache when possible, and saved to it otherwise.
+ * @param[in,out] cache Program cache
+ * @param[in] vertexSource Vertex shader source, with its includes resolved
+ * @param[in] fragmentSource Fragment shader source, with its includes resolved
+ * @param[in] defines #define lines both shaders are compiled with
+ * @return OpenGL handle to the created shader program
+ */
+inline GLuint CreateShaderProgram(ProgramCache& cache, std::string vertexSource, std::string fragmentSource, const std::string& defines = "")
+{
+	InsertShaderDefines(vertexSource, defines);
+	InsertShaderDefines(fragmentSource, defines);
+
+	// Skip compiling and linking entirely if the driver accepts the cached binary
+	uint64_t cacheKey = GetProgramCacheKey(cache, { vertexSource, fragmentSource }, defines);
+	GLuint program = LoadCachedProgram(cache, cacheKey);
+	if (program != 0)
+	{
+		return program;
+	}
+
+	GLuint shaders[2] = {
+		CreateShaderFromSource(GL_VERTEX_SHADER, vertexSource),
+		CreateShaderFromSource(GL_FRAGMENT_SHADER, fragmentSource)
+	};
+
+	program = glCreateProgram();
+	glAttachShader(program, shaders[0]);
+	glAttachShader(program, shaders[1]);
+
+	PrepareProgramForCache(cache, program);
+	glLinkProgram(program);
+
+	glDetachShader(program, shaders[0]);
+	glDeleteShader(shaders[0]);
+	glDetachShader(program, shaders[1]);
+	glDeleteShader(shaders[1]);
+
+	// Check shader program link status
+	GLint linkStatus;
+	glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+	if (linkStatus != GL_TRUE)
+	{
+		char infoLog[512];
+		GLsizei infoLogLen = sizeof(infoLog);
+		glGetProgramInfoLog(program, infoLogLen, &infoLogLen, infoLog);
+		std::cerr << "program link error: " << infoLog << std::endl;
+	}
+	else
+	{
+		StoreProgramBinary(cache, cacheKey, program);
+	}
+
+	return program;
+}
+
+/**
+ * @brief Starts watching the directory of a file, unless it is already watched.
+ * @param[in,out] library Shader library
+ * @param[in] filePath Path to the file
+ */
+inline void WatchShaderFile(ShaderLibrary& library, const std::string& filePath)
+{
+	if (!library.watching)
+	{
+		return;
+	}
+
+#ifdef __linux__
+	if (library.inotifyFd >= 0)
+	{
+		// Editors often save by writing a new file and renaming it over the old one,
+		// which only the directory sees
+		std::string directory = GetShaderDirectory(filePath);
+		if (std::find(library.watchedDirectories.begin(), library.watchedDirectories.end(), directory) == library.watchedDirectories.end())
+		{
+			int descriptor = inotify_add_watch(library.inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (descriptor >= 0)
+			{
+				library.watchedDirectories.push_back(directory);
+				library.watchDescriptors.push_back(descriptor);
+			}
+		}
+		return;
+	}
+#endif
+
+	for (const ShaderFileStamp& stamp : library.stamps)
+	{
+		if (stamp.path == filePath)
+		{
+			return;
+		}
+	}
+	std::error_code error;
+	library.stamps.push_back({ filePath, std::filesystem::last_write_time(filePath, error) });
+}
+
+/**
+ * @brief Sets up the library. Call once after GLAD has been loaded.
+ * @param[out] library Shader library to initialize
+ * @param[in] cache Program cache, which must outlive the library
+ * @param[in] watch Whether to rebuild programs when their files change
+ */
+inline void InitShaderLibrary(ShaderLibrary& library, ProgramCache& cache, bool watch)
+{
+	library = ShaderLibrary();
+	library.cache = &cache;
+	library.watching = watch;
+	library.lastPoll = glfwGetTime();
+
+#ifdef __linux__
+	if (watch)
+	{
+		library.inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	}
+#endif
+
+	// Let the driver compile on as many threads as it likes, and report when it is done
+	const char* maxThreadsName = nullptr;
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+	{
+		maxThreadsName = "glMaxShaderCompilerThreadsKHR";
+	}
+	else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+	{
+		maxThreadsName = "glMaxShaderCompilerThreadsARB";
+	}
+	if (maxThreadsName)
+	{
+		ShaderLibraryMaxCompilerThreadsProc maxCompilerThreads = reinterpret_cast<ShaderLibraryMaxCompilerThreadsProc>(glfwGetProcAddress(maxThreadsName));
+		if (maxCompilerThreads)
+		{
+			maxCompilerThreads(0xFFFFFFFFu);
+			library.parallelCompile = true;
+		}
+	}
+}
+
+/**
+ * @brief Builds a program from a vertex and a fragment shader file, and watches its files.
+ * @param[in,out] library Shader library
+ * @param[in] vertexPath Vertex shader file path
+ * @param[in] fragmentPath Fragment shader file path
+ * @param[in] defines #define lines both shaders are compiled with, kept for rebuilds
+ * @return Index of the program in library.programs. Read its handle every frame, since it changes on reload.
+ * The handle is 0 while the files cannot be read.
+ */
+inline int AddShaderProgram(ShaderLibrary& library, const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines = "")
+{
+	ShaderProgram entry;
+	entry.vertexPath = vertexPath;
+	entry.fragmentPath = fragmentPath;
+	entry.defines = defines;
+
+	// Both files are read even if the first fails, so every error is reported and every file read gets watched
+	std::string vertexSource, fragmentSource;
+	bool vertexLoaded = LoadShaderSource(vertexPath, vertexSource, entry.files);
+	bool fragmentLoaded = LoadShaderSource(fragmentPath, fragmentSource, entry.files);
+	if (vertexLoaded && fragmentLoaded)
+	{
+		entry.program = CreateShaderProgram(*library.cache, vertexSource, fragmentSource, defines);
+
+		// Resolve the uniform blocks and locations once, instead of looking up uniforms by name every frame
+		BindUniformBlocks(entry.program);
+		entry.uniforms = GetShaderUniformLocations(entry.program);
+	}
+	else
+	{
+		// The program stays 0 until a fix to its files rebuilds it, so watch them even if missing
+		std::cerr << "Not building " << vertexPath << " + " << fragmentPath << ", waiting for its files to be fixed" << std::endl;
+		for (const std::string& path : { vertexPath, fragmentPath })
+		{
+			if (std::find(entry.files.begin(), entry.files.end(), path) == entry.files.end())
+			{
+				entry.files.push_back(path);
+			}
+		}
+	}
+
+	for (const std::string& file : entry.files)
+	{
+		WatchShaderFile(library, file);
+	}
+	library.programs.push_back(entry);
+	return static_cast<int>(library.programs.size()) - 1;
+}
+
+/**
+ * @brief Marks every program built from a file as needing a rebuild.
+ * @param[in,out] library Shader library
+ * @param[in] filePath Path to the changed file
+ */
+inline void MarkShaderFileChanged(ShaderLibrary& library, const std::string& filePath)
+{
+	for (ShaderProgram& entry : library.programs)
+	{
+		if (std::find(entry.files.begin(), entry.files.end(), filePath) != entry.files.end())
+		{
+			entry.dirty = true;
+		}
+	}
+}
+
+/**
+ * @brief Collects the files that changed since the last call.
+ * @param[in,out] library Shader library
+ */
+inline void PollShaderFiles(ShaderLibrary& library)
+{
+#ifdef __linux__
+	if (library.inotifyFd >= 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		ssize_t length;
+		while ((length = read(library.inotifyFd, buffer, sizeof(buffer))) > 0)
+		{
+			for (ssize_t offset = 0; offset < length;)
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+				if (event->len == 0)
+				{
+					continue;
+				}
+
+				for (size_t i = 0; i < library.watchDescriptors.size(); i++)
+				{
+					if (library.watchDescriptors[i] == event->wd)
+					{
+						MarkShaderFileChanged(library, JoinShaderPath(library.watchedDirectories[i], event->name));
+					}
+				}
+			}
+		}
+		return;
+	}
+#endif
+
+	double now = glfwGetTime();
+	if (now - library.lastPoll < SHADER_POLL_INTERVAL)
+	{
+		return;
+	}
+	library.lastPoll = now;
+
+	for (ShaderFileStamp& stamp : library.stamps)
+	{
+		std::error_code error;
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(stamp.path, error);
+		if (!error && time != stamp.time)
+		{
+			stamp.time = time;
+			MarkShaderFileChanged(library, stamp.path);
+		}
+	}
+}
+
+/**
+ * @brief Starts rebuilding a program: reads its files again, then compiles and links them
+ * without waiting for the result.
+ * @param[in,out] library Shader library
+ * @param[in,out] entry Program to rebuild
+ */
+inline void StartShaderRebuild(ShaderLibrary& library, ShaderProgram& entry)
+{
+	entry.dirty = false;
+
+	std::vector<std::string> files;
+	std::string vertexSource, fragmentSource;
+	if (!LoadShaderSource(entry.vertexPath, vertexSource, files) || !LoadShaderSource(entry.fragmentPath, fragmentSource, files))
+	{
+		// Probably caught halfway through a save, the next write triggers another rebuild
+		return;
+	}
+
+	InsertShaderDefines(vertexSource, entry.defines);
+	InsertShaderDefines(fragmentSource, entry.defines);
+	entry.pendingKey = GetProgramCacheKey(*library.cache, { vertexSource, fragmentSource }, entry.defines);
+	entry.pendingShaders[0] = CreateShaderFromSource(GL_VERTEX_SHADER, vertexSource, false);
+	entry.pendingShaders[1] = CreateShaderFromSource(GL_FRAGMENT_SHADER, fragmentSource, false);
+	entry.pendingProgram = glCreateProgram();
+	glAttachShader(entry.pendingProgram, entry.pendingShaders[0]);
+	glAttachShader(entry.pendingProgram, entry.pendingShaders[1]);
+	PrepareProgramForCache(*library.cache, entry.pendingProgram);
+	glLinkProgram(entry.pendingProgram);
+	entry.pendingFiles = files;
+}
+
+/**
+ * @brief Finishes a rebuild whose link completed, swapping the new program in if it linked.
+ * @param[in,out] library Shader library
+ * @param[in,out] entry Program being rebuilt
+ * @param[in,out] state State cache, told about programs it may still consider current
+ */
+inline void FinishShaderRebuild(ShaderLibrary& library, ShaderProgram& entry, GLStateCache& state)
+{
+	GLint linkStatus;
+	glGetProgramiv(entry.pendingProgram, GL_LINK_STATUS, &linkStatus);
+	if (linkStatus != GL_TRUE)
+	{
+		std::cerr << "Reloading " << entry.vertexPath << " + " << entry.fragmentPath << " failed, keeping the previous program" << std::endl;
+		PrintProgramErrors(entry.pendingProgram, entry.pendingShaders, 2);
+		glDeleteProgram(entry.pendingProgram);
+	}
+	else
+	{
+		BindUniformBlocks(entry.pendingProgram);
+		StoreProgramBinary(*library.cache, entry.pendingKey, entry.pendingProgram);
+
+		glDeleteProgram(entry.program);
+		entry.program = entry.pendingProgram;
+		entry.uniforms = GetShaderUniformLocations(entry.program);
+		entry.files = entry.pendingFiles;
+		for (const std::string& file : entry.files)
+		{
+			WatchShaderFile(library, file);
+		}
+		library.reloadCount++;
+		std::cerr << "Reloaded " << entry.vertexPath << " + " << entry.fragmentPath << std::endl;
+	}
+
+	// BindUniformBlocks() switches programs behind the cache's back, and the old program's
+	// handle may be reused by the driver
+	state.program = STATE_CACHE_UNKNOWN;
+
+	glDeleteShader(entry.pendingShaders[0]);
+	glDeleteShader(entry.pendingShaders[1]);
+	entry.pendingProgram = 0;
+	entry.pendingShaders[0] = 0;
+	entry.pendingShaders[1] = 0;
+	entry.pendingFiles.clear();
+}
+
+/**
+ * @brief Picks up changed files, starts their rebuilds and swaps in the programs that finished linking.
+ * Without parallel compile support, the result of a link is only queried on the next frame,
+ * which gives drivers that compile on their own threads a frame to finish.
+ * Call once per frame, before the programs are read.
+ * @param[in,out] library Shader library
+ * @param[in,out] state State cache
+ */
+inline void UpdateShaderLibrary(ShaderLibrary& library, GLStateCache& state)
+{
+	if (!library.watching)
+	{
+		return;
+	}
+
+	PollShaderFiles(library);
+	for (ShaderProgram& entry : library.programs)
+	{
+		if (entry.pendingProgram != 0)
+		{
+			GLint complete = GL_TRUE;
+			if (library.parallelCompile)
+			{
+				glGetProgramiv(entry.pendingProgram, GL_COMPLETION_STATUS_KHR, &complete);
+			}
+			if (complete == GL_TRUE)
+			{
+				FinishShaderRebuild(library, entry, state);
+			}
+		}
+		else if (entry.dirty)
+		{
+			StartShaderRebuild(library, entry);
+		}
+	}
+}
+
+/**
+ * @brief Deletes every program of the library and stops watching their files.
+ * @param[in,out] library Shader library
+ */
+inline void DeleteShaderLibrary(ShaderLibrary& library)
+{
+	for (ShaderProgram& entry : library.programs)
+	{
+		glDeleteProgram(entry.program);
+		if (entry.pendingProgram != 0)
+		{
+			glDeleteProgram(entry.pendingProgram);
+			glDeleteShader(entry.pendingShaders[0]);
+			glDeleteShader(entry.pendingShaders[1]);
+		}
+	}
+	library.programs.clear();
+
+#ifdef __linux__
+	if (library.inotifyFd >= 0)
+	{
+		close(library.inotifyFd);
+	}
+#endif
+	library.inotifyFd = -1;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "Hash.h"
+#include "Scene.h"
+#include "ShaderLibrary.h"
+
+// ---------------
+// Shader permutations
+// ---------------
+//
+// The surface shaders are compiled into specialized variants, one per combination of
+// feature bits an object needs. Each bit becomes a #define inserted after the #version
+// line, and the shaders wrap the matching code in #ifdef, so a variant without specular
+// or point lights does not contain that math at all instead of multiplying it by zero.
+// Variants are built on first use, from the program cache when possible, and found again
+// by a key made of the shader paths and the feature bits.
+
+/**
+ * Feature bits of a shader variant
+ */
+enum ShaderFeature : uint32_t
+{
+	SHADER_FEATURE_TEXTURED = 1u << 0,		// Samples the material array instead of using the vertex color
+	SHADER_FEATURE_SPECULAR = 1u << 1,		// Specular term of every light
+	SHADER_FEATURE_POINT_LIGHTS = 1u << 2,	// Attenuated point lights of the fragment's cluster
+	SHADER_FEATURE_ALL = (1u << 3) - 1,		// Every material feature
+
+	// Not a material feature: set for every variant when the meshes are uploaded packed
+	SHADER_FEATURE_PACKED_VERTICES = 1u << 3	// Dequantizes the positions of PackedVertex
+};
+
+/**
+ * Define of each feature bit, in bit order
+ */
+const char* const SHADER_FEATURE_DEFINES[] = { "TEXTURED", "SPECULAR", "POINT_LIGHTS", "PACKED_VERTICES" };
+
+/**
+ * Struct containing the variants built so far
+ */
+struct ShaderVariants
+{
+	std::unordered_map<uint64_t, int> programs;		// Variant key to index in ShaderLibrary::programs
+};
+
+/**
+ * @brief Gets the #define lines of a combination of feature bits.
+ * @param[in] features Combination of ShaderFeature bits
+ * @return One #define line per set bit
+ */
+inline std::string GetShaderFeatureDefines(uint32_t features)
+{
+	std::string defines;
+	for (uint32_t bit = 0; bit < sizeof(SHADER_FEATURE_DEFINES) / sizeof(SHADER_FEATURE_DEFINES[0]); bit++)
+	{
+		if (features & (1u << bit))
+		{
+			defines += std::string("#define ") + SHADER_FEATURE_DEFINES[bit] + "\n";
+		}
+	}
+	return defines;
+}
+
+/**
+ * @brief Gets the features a scene object is drawn with. Objects have every feature unless their flags opt out.
+ * @param[in] flags Combination of SceneObjectFlags
+ * @return Combination of ShaderFeature bits
+ */
+inline uint32_t GetObjectShaderFeatures(uint32_t flags)
+{
+	uint32_t features = SHADER_FEATURE_ALL;
+	if (flags & SCENE_OBJECT_UNTEXTURED)
+	{
+		features &= ~SHADER_FEATURE_TEXTURED;
+	}
+	if (flags & SCENE_OBJECT_NO_SPECULAR)
+	{
+		features &= ~SHADER_FEATURE_SPECULAR;
+	}
+	if (flags & SCENE_OBJECT_NO_POINT_LIGHTS)
+	{
+		features &= ~SHADER_FEATURE_POINT_LIGHTS;
+	}
+	return features;
+}
+
+/**
+ * @brief Computes the key of a variant.
+ * @param[in] vertexPath Vertex shader file path
+ * @param[in] fragmentPath Fragment shader file path
+ * @param[in] features Combination of ShaderFeature bits
+ * @return Key of the variant
+ */
+inline uint64_t GetShaderVariantKey(const std::string& vertexPath, const std::string& fragmentPath, uint32_t features)
+{
+	uint64_t key = HashString(vertexPath);
+	key = HashString(fragmentPath, key);
+	return HashBytes(&features, sizeof(features), key);
+}
+
+/**
+ * @brief Gets a variant of a program, building it if it does not exist yet.
+ * Building compiles shaders, so request every variant a scene needs before the render loop starts.
+ * @param[in,out] variants Variants built so far
+ * @param[in,out] library Shader library the variants are built in
+ * @param[in] vertexPath Vertex shader file path
+ * @param[in] fragmentPath Fragment shader file path
+ * @param[in] features Combination of ShaderFeature bits
+ * @return Index of the variant in library.programs
+ */
+inline int GetShaderVariant(ShaderVariants& variants, ShaderLibrary& library, const std::string& vertexPath, const std::string& fragmentPath, uint32_t features)
+{
+	uint64_t key = GetShaderVariantKey(vertexPath, fragmentPath, features);
+	auto found = variants.programs.find(key);
+	if (found != variants.programs.end())
+	{
+		return found->second;
+	}
+
+	int index = AddShaderProgram(library, vertexPath, fragmentPath, GetShaderFeatureDefines(features));
+	variants.programs.emplace(key, index);
+	return index;
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Hash.h"
+
+// ---------------
+// On-disk texture cache
+// ---------------
+//
+// Next to each source image, a .texcache file stores its complete mip chain in the exact
+// form glTexSubImage3D/glCompressedTexSubImage3D expects. The cache is keyed by a hash of the
+// source file's bytes, so editing the image invalidates it. A warm start reads the cache
+// instead of decoding the image.
+
+const char TEXTURE_CACHE_MAGIC[4] = { 'T', 'X', 'C', 'H' };
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+/**
+ * Struct containing the location of one mip level inside TextureData::data
+ */
+struct TextureLevel
+{
+	int width = 0;
+	int height = 0;
+	size_t offset = 0;
+	size_t size = 0;
+};
+
+/**
+ * Struct containing the mip chain of a texture, ready to be uploaded
+ */
+struct TextureData
+{
+	GLenum internalFormat = GL_RGB8;	// GL_RGB8, or the compressed format the driver picked
+	bool compressed = false;
+	uint64_t sourceHash = 0;
+	std::vector<TextureLevel> levels;
+	std::vector<unsigned char> data;	// All levels back to back
+};
+
+/**
+ * Header at the start of a texture cache file. It is followed by one
+ * TextureCacheLevel per mip level, then by the level data.
+ */
+struct TextureCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t internalFormat;
+	uint32_t compressed;
+	uint32_t levelCount;
+	uint32_t pad;
+};
+
+/**
+ * Description of one mip level inside a texture cache file
+ */
+struct TextureCacheLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint64_t size;
+};
+
+/**
+ * @brief Gets the path of the cache file belonging to a source image.
+ * @param[in] sourcePath Path to the source image
+ * @return Path to the cache file
+ */
+inline std::string GetTextureCachePath(const std::string& sourcePath)
+{
+	return sourcePath + ".texcache";
+}
+
+/**
+ * @brief Hashes the contents of a file with 64-bit FNV-1a.
+ * @param[in] filePath Path to the file
+ * @param[out] hash Hash of the file's bytes
+ * @return True if the file could be read, false otherwise
+ */
+inline bool HashFileContents(const std::string& filePath, uint64_t& hash)
+{
+	std::ifstream file(filePath, std::ios::binary);
+	if (file.fail())
+	{
+		return false;
+	}
+
+	hash = FNV1A_OFFSET_BASIS;
+	char buffer[64 * 1024];
+	while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+	{
+		hash = HashBytes(buffer, static_cast<size_t>(file.gcount()), hash);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Builds a full RGB8 mip chain with a 2x2 box filter, down to 1x1.
+ * @param[in] pixels Tightly packed RGB8 pixels of the base level
+ * @param[in] width Width of the base level
+ * @param[in] height Height of the base level
+ * @param[out] texture Texture receiving the mip chain
+ */
+inline void BuildMipChain(const unsigned char* pixels, int width, int height, TextureData& texture)
+{
+	texture.internalFormat = GL_RGB8;
+	texture.compressed = false;
+	texture.levels.clear();
+
+	TextureLevel base;
+	base.width = width;
+	base.height = height;
+	base.size = static_cast<size_t>(width) * height * 3;
+	texture.levels.push_back(base);
+	texture.data.assign(pixels, pixels + base.size);
+
+	while (texture.levels.back().width > 1 || texture.levels.back().height > 1)
+	{
+		TextureLevel source = texture.levels.back();
+		TextureLevel level;
+		level.width = std::max(1, source.width / 2);
+		level.height = std::max(1, source.height / 2);
+		level.offset = texture.data.size();
+		level.size = static_cast<size_t>(level.width) * level.height * 3;
+		texture.data.resize(level.offset + level.size);
+
+		const unsigned char* src = texture.data.data() + source.offset;
+		unsigned char* dst = texture.data.data() + level.offset;
+		for (int y = 0; y < level.height; y++)
+		{
+			// Clamp so odd sizes reuse the last row/column instead of reading past the level
+			int y0 = std::min(y * 2, source.height - 1);
+			int y1 = std::min(y * 2 + 1, source.height - 1);
+			for (int x = 0; x < level.width; x++)
+			{
+				int x0 = std::min(x * 2, source.width - 1);
+				int x1 = std::min(x * 2 + 1, source.width - 1);
+				for (int c = 0; c < 3; c++)
+				{
+					int sum = src[(y0 * source.width + x0) * 3 + c] + src[(y0 * source.width + x1) * 3 + c] +
+						src[(y1 * source.width + x0) * 3 + c] + src[(y1 * source.width + x1) * 3 + c];
+					dst[(y * level.width + x) * 3 + c] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+
+		texture.levels.push_back(level);
+	}
+}
+
+/**
+ * @brief Reads a texture cache file, if it exists and was built from the same source contents.
+ * @param[in] cachePath Path to the cache file
+ * @param[in] sourceHash Hash of the current source image
+ * @param[in] compressed Whether a block-compressed cache entry is wanted
+ * @param[out] texture Cached mip chain on success
+ * @return True on a cache hit, false otherwise
+ */
+inline bool ReadTextureCache(const std::string& cachePath, uint64_t sourceHash, bool compressed, TextureData& texture)
+{
+	std::ifstream file(cachePath, std::ios::binary);
+	if (file.fail())
+	{
+		return false;
+	}
+
+	TextureCacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		std::memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != TEXTURE_CACHE_VERSION ||
+		header.sourceHash != sourceHash ||
+		(header.compressed != 0) != compressed ||
+		header.levelCount == 0 || header.levelCount > 32)
+	{
+		return false;
+	}
+
+	texture.internalFormat = header.internalFormat;
+	texture.compressed = header.compressed != 0;
+	texture.sourceHash = sourceHash;
+	texture.levels.resize(header.levelCount);
+
+	size_t totalSize = 0;
+	for (TextureLevel& level : texture.levels)
+	{
+		TextureCacheLevel entry;
+		if (!file.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+		{
+			return false;
+		}
+		level.width = static_cast<int>(entry.width);
+		level.height = static_cast<int>(entry.height);
+		level.offset = totalSize;
+		level.size = static_cast<size_t>(entry.size);
+		totalSize += level.size;
+	}
+
+	texture.data.resize(totalSize);
+	return static_cast<bool>(file.read(reinterpret_cast<char*>(texture.data.data()), static_cast<std::streamsize>(totalSize)));
+}
+
+/**
+ * @brief Writes a mip chain to a texture cache file.
+ * @param[in] cachePath Path to the cache file
+ * @param[in] texture Mip chain to store, with its source hash
+ * @return True if the file was written, false otherwise
+ */
+inline bool WriteTextureCache(const std::string& cachePath, const TextureData& texture)
+{
+	std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+	if (file.fail())
+	{
+		std::cerr << "Unable to write texture cache: " << cachePath << std::endl;
+		return false;
+	}
+
+	TextureCacheHeader header = {};
+	std::memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = TEXTURE_CACHE_VERSION;
+	header.sourceHash = texture.sourceHash;
+	header.internalFormat = texture.internalFormat;
+	header.compressed = texture.compressed ? 1 : 0;
+	header.levelCount = static_cast<uint32_t>(texture.levels.size());
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (const TextureLevel& level : texture.levels)
+	{
+		TextureCacheLevel entry;
+		entry.width = static_cast<uint32_t>(level.width);
+		entry.height = static_cast<uint32_t>(level.height);
+		entry.size = level.size;
+		file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	}
+	file.write(reinterpret_cast<const char*>(texture.data.data()), static_cast<std::streamsize>(texture.data.size()));
+
+	return !file.fail();
+}
+
+/**
+ * @brief Compresses a mip chain with the driver, through a scratch texture.
+ * This waits for the GPU, so it only runs on a cold start.
+ * @param[in] internalFormat Compressed format the driver picks for GL_COMPRESSED_RGB
+ * @param[in,out] texture Uncompressed mip chain, replaced by the compressed one on success
+ * @return True if every level was compressed to internalFormat, false otherwise
+ */
+inline bool CompressMipChain(GLenum internalFormat, TextureData& texture)
+{
+	int levelCount = static_cast<int>(texture.levels.size());
+
+	GLuint scratch;
+	glGenTextures(1, &scratch);
+	glBindTexture(GL_TEXTURE_2D, scratch);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < levelCount; i++)
+	{
+		const TextureLevel& level = texture.levels[i];
+		glTexImage2D(GL_TEXTURE_2D, i, GL_COMPRESSED_RGB, level.width, level.height, 0, GL_RGB, GL_UNSIGNED_BYTE, texture.data.data() + level.offset);
+	}
+
+	GLint actualFormat = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &actualFormat);
+	bool success = static_cast<GLenum>(actualFormat) == internalFormat;
+	if (success)
+	{
+		TextureData compressed;
+		compressed.internalFormat = internalFormat;
+		compressed.compressed = true;
+		compressed.sourceHash = texture.sourceHash;
+		for (int i = 0; i < levelCount; i++)
+		{
+			TextureLevel level = texture.levels[i];
+			GLint size;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			level.offset = compressed.data.size();
+			level.size = static_cast<size_t>(size);
+			compressed.data.resize(level.offset + level.size);
+			glGetCompressedTexImage(GL_TEXTURE_2D, i, compressed.data.data() + level.offset);
+			compressed.levels.push_back(level);
+		}
+		texture = std::move(compressed);
+	}
+	else
+	{
+		std::cerr << "The driver compressed a texture to an unexpected format, it is uploaded uncompressed" << std::endl;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteTextures(1, &scratch);
+
+	return success;
+}
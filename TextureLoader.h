@@ -0,0 +1,272 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GLState.h"
+#include "MaterialArray.h"
+#include "TextureCache.h"
+
+// ---------------
+// Asynchronous texture loading
+// ---------------
+//
+// Images are decoded on a pool of worker threads and resampled to the layer size of the
+// material array. The render thread shows the placeholder layers until a decode finishes,
+// then uploads the pixels through a pixel buffer object so glTexSubImage3D returns
+// without waiting for the copy to reach the GPU.
+// Workers first look for a texture cache entry (see TextureCache.h), in which case the
+// image is not decoded at all. Layers showing the same image share a single job, so an
+// image is decoded once and its cache file only ever has one writer.
+
+/**
+ * Struct containing the mip chain of an image prepared by a worker thread, waiting to be uploaded
+ */
+struct DecodedImage
+{
+	size_t source = 0;			// Index of the source image in TextureLoader::paths
+	TextureData texture;
+	bool fromCache = false;
+};
+
+/**
+ * Struct containing the state shared between the render thread and the decode workers
+ */
+struct TextureLoader
+{
+	std::vector<std::string> paths;				// Distinct source images, one job each
+	std::vector<std::vector<GLint>> layers;		// Layers of the material array showing each source image
+	MaterialArray materials;
+	std::vector<std::thread> workers;
+
+	// Index of the next image a worker should decode
+	std::atomic<size_t> nextJob{ 0 };
+
+	// Decoded images, filled by the workers and drained by the render thread
+	std::mutex finishedMutex;
+	std::deque<DecodedImage> finished;
+
+	// Number of images not uploaded yet (including failed decodes, which are never uploaded)
+	size_t remaining = 0;
+	std::atomic<size_t> failed{ 0 };
+	std::atomic<size_t> cacheHits{ 0 };
+
+	GLuint pbo = 0;
+};
+
+/**
+ * @brief Prepares the mip chains of images until no job is left. Runs on a worker thread.
+ * @param[in,out] loader Loader owning the jobs
+ */
+inline void RunTextureDecodeWorker(TextureLoader* loader)
+{
+	for (size_t job = loader->nextJob++; job < loader->paths.size(); job = loader->nextJob++)
+	{
+		const std::string& path = loader->paths[job];
+		std::string cachePath = GetTextureCachePath(path);
+
+		DecodedImage image;
+		image.source = job;
+
+		uint64_t sourceHash;
+		if (!HashFileContents(path, sourceHash))
+		{
+			std::cerr << "Unable to load texture: " << path << std::endl;
+			loader->failed++;
+			continue;
+		}
+
+		// Warm start: the cache holds the whole mip chain, so skip decoding entirely.
+		// Entries built for another layer size or compressed format are rebuilt.
+		const MaterialArray& materials = loader->materials;
+		image.fromCache = ReadTextureCache(cachePath, sourceHash, materials.compressed, image.texture) &&
+			image.texture.levels[0].width == materials.layerSize && image.texture.levels[0].height == materials.layerSize &&
+			static_cast<int>(image.texture.levels.size()) == materials.levelCount &&
+			(!materials.compressed || image.texture.internalFormat == materials.internalFormat);
+		if (image.fromCache)
+		{
+			loader->cacheHits++;
+		}
+		else
+		{
+			int width, height, numChannels;
+			unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &numChannels, 3);
+			if (pixels == nullptr)
+			{
+				std::cerr << "Unable to load texture: " << path << std::endl;
+				loader->failed++;
+				continue;
+			}
+
+			if (width != materials.layerSize || height != materials.layerSize)
+			{
+				std::vector<unsigned char> resampled = ResampleImage(pixels, width, height, materials.layerSize, materials.layerSize);
+				BuildMipChain(resampled.data(), materials.layerSize, materials.layerSize, image.texture);
+			}
+			else
+			{
+				BuildMipChain(pixels, width, height, image.texture);
+			}
+			image.texture.sourceHash = sourceHash;
+			stbi_image_free(pixels);
+
+			// Uncompressed chains are final already. Compressed ones are written by the
+			// render thread, once the driver has compressed them.
+			if (!materials.compressed)
+			{
+				WriteTextureCache(cachePath, image.texture);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(loader->finishedMutex);
+		loader->finished.push_back(std::move(image));
+	}
+}
+
+/**
+ * @brief Starts decoding the images of the material layers in the background.
+ * @param[in,out] loader Loader to start
+ * @param[in] paths Path to the image of every layer
+ * @param[in] materials Material array receiving the images, with its placeholder layers created
+ */
+inline void StartTextureLoads(TextureLoader& loader, const std::vector<std::string>& paths, const MaterialArray& materials)
+{
+	loader.materials = materials;
+
+	// Scenes may reference one image from several layers, gather those under one job
+	size_t layerCount = std::min(paths.size(), static_cast<size_t>(materials.layerCount));
+	for (size_t layer = 0; layer < layerCount; layer++)
+	{
+		size_t source = std::find(loader.paths.begin(), loader.paths.end(), paths[layer]) - loader.paths.begin();
+		if (source == loader.paths.size())
+		{
+			loader.paths.push_back(paths[layer]);
+			loader.layers.emplace_back();
+		}
+		loader.layers[source].push_back(static_cast<GLint>(layer));
+	}
+	loader.remaining = loader.paths.size();
+
+	glGenBuffers(1, &loader.pbo);
+
+	// stb_image reads this flag on every decode, so set it before any worker starts
+	stbi_set_flip_vertically_on_load(true);
+
+	size_t workerCount = std::min<size_t>(loader.paths.size(), std::max(1u, std::thread::hardware_concurrency()));
+	for (size_t i = 0; i < workerCount; i++)
+	{
+		loader.workers.emplace_back(RunTextureDecodeWorker, &loader);
+	}
+}
+
+/**
+ * @brief Uploads decoded images to their textures. Call once per frame from the render thread.
+ * At least one image is uploaded per call, more as long as the byte budget allows.
+ * @param[in,out] loader Loader owning the decoded images
+ * @param[in,out] state State cache
+ * @param[in] byteBudget Maximum number of bytes to upload in this call
+ * @return True while some textures are still waiting to be uploaded
+ */
+inline bool UploadFinishedTextures(TextureLoader& loader, GLStateCache& state, size_t byteBudget)
+{
+	size_t uploadedBytes = 0;
+	while (loader.remaining > loader.failed && uploadedBytes < byteBudget)
+	{
+		DecodedImage image;
+		{
+			std::lock_guard<std::mutex> lock(loader.finishedMutex);
+			if (loader.finished.empty())
+			{
+				break;
+			}
+			image = std::move(loader.finished.front());
+			loader.finished.pop_front();
+		}
+
+		TextureData& texture = image.texture;
+		const MaterialArray& materials = loader.materials;
+
+		// Cold start with compression: let the driver compress the chain in a scratch texture,
+		// then store the result, so the next launch uploads the compressed blocks directly
+		if (!image.fromCache && materials.compressed)
+		{
+			// The scratch texture goes through GL_TEXTURE_2D of the active unit and the
+			// pixel unpack binding, so make sure both are what the state cache expects
+			BindBuffer(state, GL_PIXEL_UNPACK_BUFFER, 0);
+			BindTexture(state, MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D, 0);
+			if (CompressMipChain(materials.internalFormat, texture))
+			{
+				WriteTextureCache(GetTextureCachePath(loader.paths[image.source]), texture);
+			}
+		}
+
+		// Respecifying the buffer orphans the previous upload, which may still be in flight
+		BindBuffer(state, GL_PIXEL_UNPACK_BUFFER, loader.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, texture.data.size(), nullptr, GL_STREAM_DRAW);
+		void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, texture.data.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped != nullptr)
+		{
+			std::memcpy(mapped, texture.data.data(), texture.data.size());
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+			// With a pixel unpack buffer bound, the data pointer is an offset into that buffer.
+			// Every layer showing the image is filled from the same buffer.
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			BindTexture(state, MATERIAL_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, materials.texture);
+			for (GLint layer : loader.layers[image.source])
+			{
+				for (int i = 0; i < static_cast<int>(texture.levels.size()); i++)
+				{
+					const TextureLevel& level = texture.levels[i];
+					if (texture.compressed)
+					{
+						glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, texture.internalFormat,
+							static_cast<GLsizei>(level.size), (void*)level.offset);
+					}
+					else
+					{
+						glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, GL_RGB, GL_UNSIGNED_BYTE, (void*)level.offset);
+					}
+				}
+			}
+
+			// No unbind: the render loop samples the array from this same unit
+		}
+		BindBuffer(state, GL_PIXEL_UNPACK_BUFFER, 0);
+
+		uploadedBytes += texture.data.size() * loader.layers[image.source].size();
+		loader.remaining--;
+	}
+
+	return loader.remaining > loader.failed;
+}
+
+/**
+ * @brief Waits for the workers to finish and releases everything the loader still holds.
+ * @param[in,out] loader Loader to stop
+ */
+inline void StopTextureLoader(TextureLoader& loader)
+{
+	// Make the workers stop after their current decode
+	loader.nextJob = loader.paths.size();
+	for (std::thread& worker : loader.workers)
+	{
+		worker.join();
+	}
+	loader.workers.clear();
+
+	loader.finished.clear();
+
+	glDeleteBuffers(1, &loader.pbo);
+	loader.pbo = 0;
+}
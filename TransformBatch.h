@@ -0,0 +1,390 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "GLState.h"
+#include "UniformBuffers.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_BATCH_SSE 1
+#include <emmintrin.h>
+#endif
+
+// ---------------
+// Batch transform stage
+// ---------------
+//
+// Model matrices are stored structure-of-arrays, one array per matrix element, so four
+// objects fill one SSE register and the MVPs of the whole scene are computed in a single
+// pass, straight into the mapped per-object buffer. The pass only runs in frames where
+// the view-projection or one of the transforms changed.
+//
+// The normal matrix is the inverse transpose of the model's upper 3x3. It is computed and
+// cached when a transform is set, see SceneGraph.h for when that happens. For rigid and
+// uniformly scaled transforms, M = s * R, it is M / s^2, so only general transforms pay
+// for the inverse.
+
+const size_t TRANSFORM_BATCH_WIDTH = 4;		// Objects per SIMD register
+const float TRANSFORM_ORTHOGONAL_EPSILON = 1e-4f;
+
+/**
+ * Struct containing the model matrices of a batch of objects, structure-of-arrays
+ */
+struct TransformBatch
+{
+	size_t count = 0;
+	std::vector<float> model[16];	// model[column * 4 + row][object], padded to a multiple of TRANSFORM_BATCH_WIDTH
+	std::vector<float> normal[9];	// normal[column * 3 + row][object], the cached normal matrices
+	std::vector<GLint> layers;		// Layer of the material array of each object
+
+	// The per-object buffer holds the blocks of this view-projection, unless a transform changed since
+	glm::mat4 viewProj = glm::mat4(0.0f);
+	bool dirty = true;
+};
+
+/**
+ * @brief Checks whether the upper 3x3 of a matrix is a rotation (or reflection) times a uniform scale.
+ * @param[in] model Model matrix
+ * @return 1 / s^2 if the matrix is rigid or uniformly scaled by s, 0 if it needs the general inverse
+ */
+inline float ClassifyTransform(const glm::mat4& model)
+{
+	glm::vec3 x = glm::vec3(model[0]);
+	glm::vec3 y = glm::vec3(model[1]);
+	glm::vec3 z = glm::vec3(model[2]);
+	float lengthSq = glm::dot(x, x);
+	float tolerance = TRANSFORM_ORTHOGONAL_EPSILON * lengthSq;
+	if (lengthSq <= 0.0f ||
+		std::fabs(glm::dot(y, y) - lengthSq) > tolerance || std::fabs(glm::dot(z, z) - lengthSq) > tolerance ||
+		std::fabs(glm::dot(x, y)) > tolerance || std::fabs(glm::dot(y, z)) > tolerance || std::fabs(glm::dot(z, x)) > tolerance)
+	{
+		return 0.0f;
+	}
+	return 1.0f / lengthSq;
+}
+
+/**
+ * @brief Resizes a batch. New objects start with the identity transform.
+ * @param[in,out] batch Transform batch
+ * @param[in] count Number of objects
+ */
+inline void ResizeTransformBatch(TransformBatch& batch, size_t count)
+{
+	size_t padded = (count + TRANSFORM_BATCH_WIDTH - 1) / TRANSFORM_BATCH_WIDTH * TRANSFORM_BATCH_WIDTH;
+	for (int element = 0; element < 16; element++)
+	{
+		// Elements on the diagonal are 1 in the identity
+		batch.model[element].resize(padded, element % 5 == 0 ? 1.0f : 0.0f);
+	}
+	for (int element = 0; element < 9; element++)
+	{
+		batch.normal[element].resize(padded, element % 4 == 0 ? 1.0f : 0.0f);
+	}
+	batch.layers.resize(padded, 0);
+	batch.count = count;
+	batch.dirty = true;
+}
+
+/**
+ * @brief Sets the model matrix of one object and computes its normal matrix.
+ * @param[in,out] batch Transform batch
+ * @param[in] index Index of the object, below batch.count
+ * @param[in] model Model matrix of the object
+ * @param[in] layer Layer of the material array the object samples
+ */
+inline void SetBatchTransform(TransformBatch& batch, size_t index, const glm::mat4& model, GLint layer)
+{
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			batch.model[column * 4 + row][index] = model[column][row];
+		}
+	}
+
+	float normalScale = ClassifyTransform(model);
+	glm::mat3 normalMatrix = normalScale > 0.0f ?
+		glm::mat3(model) * normalScale :
+		glm::transpose(glm::inverse(glm::mat3(model)));
+	for (int column = 0; column < 3; column++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			batch.normal[column * 3 + row][index] = normalMatrix[column][row];
+		}
+	}
+
+	batch.layers[index] = layer;
+	batch.dirty = true;
+}
+
+/**
+ * @brief Computes the per-object block of one object of a batch with glm, the path without SSE.
+ * @param[in] batch Transform batch
+ * @param[in] index Index of the object
+ * @param[in] viewProj Combined projection and view matrix of the frame
+ * @param[out] output Where the block is written
+ */
+inline void ComputeObjectBlock(const TransformBatch& batch, size_t index, const glm::mat4& viewProj, unsigned char* output)
+{
+	ObjectBlock block = {};
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			block.model[column][row] = batch.model[column * 4 + row][index];
+		}
+	}
+	block.mvp = viewProj * block.model;
+
+	for (int column = 0; column < 3; column++)
+	{
+		block.norm[column] = glm::vec4(batch.normal[column * 3][index], batch.normal[column * 3 + 1][index], batch.normal[column * 3 + 2][index], 0.0f);
+	}
+	block.layer = batch.layers[index];
+
+	std::memcpy(output, &block, sizeof(block));
+}
+
+/**
+ * @brief Computes the per-object blocks of every object of a batch in one pass.
+ * Every byte of each block is written and none is read back, so output may point into a mapped buffer.
+ * @param[in] batch Transform batch
+ * @param[in] viewProj Combined projection and view matrix of the frame
+ * @param[out] output Where the block of the first object is written
+ * @param[in] stride Distance in bytes between two blocks, at least sizeof(ObjectBlock)
+ */
+inline void ComputeObjectBlocks(const TransformBatch& batch, const glm::mat4& viewProj, unsigned char* output, size_t stride)
+{
+#ifdef TRANSFORM_BATCH_SSE
+	__m128 viewProjSplat[16];
+	for (int column = 0; column < 4; column++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			viewProjSplat[column * 4 + row] = _mm_set1_ps(viewProj[column][row]);
+		}
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	for (size_t first = 0; first < batch.count; first += TRANSFORM_BATCH_WIDTH)
+	{
+		// m[column * 4 + row] holds that element of four objects
+		__m128 m[16];
+		for (int element = 0; element < 16; element++)
+		{
+			m[element] = _mm_loadu_ps(&batch.model[element][first]);
+		}
+
+		// MVP, element by element, each one a dot product of a view-projection row and a model column
+		__m128 mvp[16];
+		for (int column = 0; column < 4; column++)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				__m128 sum = _mm_mul_ps(viewProjSplat[row], m[column * 4]);
+				sum = _mm_add_ps(sum, _mm_mul_ps(viewProjSplat[4 + row], m[column * 4 + 1]));
+				sum = _mm_add_ps(sum, _mm_mul_ps(viewProjSplat[8 + row], m[column * 4 + 2]));
+				sum = _mm_add_ps(sum, _mm_mul_ps(viewProjSplat[12 + row], m[column * 4 + 3]));
+				mvp[column * 4 + row] = sum;
+			}
+		}
+
+		// Cached normal matrices, padded to vec4 columns
+		__m128 norm[12];
+		for (int column = 0; column < 3; column++)
+		{
+			for (int row = 0; row < 3; row++)
+			{
+				norm[column * 4 + row] = _mm_loadu_ps(&batch.normal[column * 3 + row][first]);
+			}
+			norm[column * 4 + 3] = zero;
+		}
+
+		// Back to one block per object: transposing four lanes of a column gives four objects' columns
+		unsigned char* blocks[TRANSFORM_BATCH_WIDTH];
+		for (size_t lane = 0; lane < TRANSFORM_BATCH_WIDTH; lane++)
+		{
+			blocks[lane] = output + (first + lane) * stride;
+		}
+		size_t laneCount = std::min(TRANSFORM_BATCH_WIDTH, batch.count - first);
+
+		for (int column = 0; column < 4; column++)
+		{
+			__m128 mvpColumn[4] = { mvp[column * 4], mvp[column * 4 + 1], mvp[column * 4 + 2], mvp[column * 4 + 3] };
+			__m128 modelColumn[4] = { m[column * 4], m[column * 4 + 1], m[column * 4 + 2], m[column * 4 + 3] };
+			_MM_TRANSPOSE4_PS(mvpColumn[0], mvpColumn[1], mvpColumn[2], mvpColumn[3]);
+			_MM_TRANSPOSE4_PS(modelColumn[0], modelColumn[1], modelColumn[2], modelColumn[3]);
+			for (size_t lane = 0; lane < laneCount; lane++)
+			{
+				_mm_storeu_ps(reinterpret_cast<float*>(blocks[lane] + offsetof(ObjectBlock, mvp)) + column * 4, mvpColumn[lane]);
+				_mm_storeu_ps(reinterpret_cast<float*>(blocks[lane] + offsetof(ObjectBlock, model)) + column * 4, modelColumn[lane]);
+			}
+		}
+		for (int column = 0; column < 3; column++)
+		{
+			__m128 normColumn[4] = { norm[column * 4], norm[column * 4 + 1], norm[column * 4 + 2], norm[column * 4 + 3] };
+			_MM_TRANSPOSE4_PS(normColumn[0], normColumn[1], normColumn[2], normColumn[3]);
+			for (size_t lane = 0; lane < laneCount; lane++)
+			{
+				_mm_storeu_ps(reinterpret_cast<float*>(blocks[lane] + offsetof(ObjectBlock, norm)) + column * 4, normColumn[lane]);
+			}
+		}
+		for (size_t lane = 0; lane < laneCount; lane++)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(blocks[lane] + offsetof(ObjectBlock, layer)), _mm_setr_epi32(batch.layers[first + lane], 0, 0, 0));
+		}
+	}
+#else
+	for (size_t i = 0; i < batch.count; i++)
+	{
+		ComputeObjectBlock(batch, i, viewProj, output + i * stride);
+	}
+#endif
+}
+
+/**
+ * @brief Computes the per-object blocks of a batch directly into the per-object buffer.
+ * Does nothing if neither the view-projection nor any transform changed since the last call.
+ * Falls back to the staging area and a regular upload if the buffer cannot be mapped.
+ * @param[in,out] state State cache
+ * @param[in,out] buffers Uniform buffers owning the per-object buffer, with room for every object of the batch
+ * @param[in,out] batch Transform batch
+ * @param[in] viewProj Combined projection and view matrix of the frame
+ * @return True if the blocks were written, false if the buffer was already up to date
+ */
+inline bool WriteObjectBlocks(GLStateCache& state, UniformBuffers& buffers, TransformBatch& batch, const glm::mat4& viewProj)
+{
+	GLsizeiptr objectCount = static_cast<GLsizeiptr>(batch.count);
+	if (objectCount == 0 || (!batch.dirty && viewProj == batch.viewProj))
+	{
+		return false;
+	}
+	batch.viewProj = viewProj;
+	batch.dirty = false;
+
+	// Invalidating the whole buffer lets the driver hand out fresh memory instead of waiting
+	// for the previous frame's draws, like the orphaning upload does
+	BindBuffer(state, GL_UNIFORM_BUFFER, buffers.object);
+	void* mapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, buffers.objectStride * objectCount, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped)
+	{
+		ComputeObjectBlocks(batch, viewProj, static_cast<unsigned char*>(mapped), static_cast<size_t>(buffers.objectStride));
+		if (glUnmapBuffer(GL_UNIFORM_BUFFER) == GL_TRUE)
+		{
+			return true;
+		}
+	}
+
+	// The mapping failed, or its contents were lost
+	ComputeObjectBlocks(batch, viewProj, buffers.objectStaging.data(), static_cast<size_t>(buffers.objectStride));
+	UploadObjectBlocks(state, buffers, objectCount);
+	return true;
+}
+
+/**
+ * @brief Times the batch transform stage against building every block with glm one object at a time,
+ * and prints the results as JSON on stdout. Only the per-frame work is timed, so the batch's
+ * cached normal matrices are computed beforehand. Needs no OpenGL context.
+ * @param[in] objectCount Number of objects, a mix of rigid, uniformly scaled and general transforms
+ * @param[in] iterations Number of passes each path is timed over
+ */
+inline void RunTransformBenchmark(size_t objectCount, int iterations)
+{
+	const size_t stride = 256;	// A typical GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT multiple of sizeof(ObjectBlock)
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+	// One third each of rigid, uniformly scaled and non-uniformly scaled objects
+	std::vector<glm::mat4> models(objectCount);
+	for (size_t i = 0; i < objectCount; i++)
+	{
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random), position(random)));
+		model = glm::rotate(model, angle(random), glm::normalize(glm::vec3(position(random), position(random), position(random)) + glm::vec3(0.0f, 0.0f, 1e-3f)));
+		if (i % 3 == 1)
+		{
+			model = glm::scale(model, glm::vec3(scale(random)));
+		}
+		else if (i % 3 == 2)
+		{
+			model = glm::scale(model, glm::vec3(scale(random), scale(random), scale(random)));
+		}
+		models[i] = model;
+	}
+
+	TransformBatch batch;
+	ResizeTransformBatch(batch, objectCount);
+	UniformBuffers reference;
+	reference.objectStride = stride;
+	reference.objectStaging.resize(objectCount * stride);
+	for (size_t i = 0; i < objectCount; i++)
+	{
+		SetBatchTransform(batch, i, models[i], static_cast<GLint>(i % 5));
+	}
+	std::vector<unsigned char> output(objectCount * stride);
+
+	glm::mat4 viewProj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f) *
+		glm::lookAt(glm::vec3(0.0f, 15.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	// The previous per-object path, as the render loop ran it
+	auto glmStart = std::chrono::steady_clock::now();
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		for (size_t i = 0; i < objectCount; i++)
+		{
+			StageObjectBlock(reference, static_cast<GLsizeiptr>(i), viewProj, models[i], static_cast<GLint>(i % 5));
+		}
+	}
+	auto glmEnd = std::chrono::steady_clock::now();
+
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		ComputeObjectBlocks(batch, viewProj, output.data(), stride);
+	}
+	auto batchEnd = std::chrono::steady_clock::now();
+
+	// Both paths have to agree, up to rounding
+	float maxError = 0.0f;
+	for (size_t i = 0; i < objectCount; i++)
+	{
+		const float* expected = reinterpret_cast<const float*>(&reference.objectStaging[i * stride]);
+		const float* actual = reinterpret_cast<const float*>(&output[i * stride]);
+		for (size_t element = 0; element < offsetof(ObjectBlock, layer) / sizeof(float); element++)
+		{
+			float magnitude = std::max(1.0f, std::fabs(expected[element]));
+			maxError = std::max(maxError, std::fabs(expected[element] - actual[element]) / magnitude);
+		}
+	}
+
+	double glmMs = std::chrono::duration<double, std::milli>(glmEnd - glmStart).count() / iterations;
+	double batchMs = std::chrono::duration<double, std::milli>(batchEnd - glmEnd).count() / iterations;
+	std::printf("{\n");
+	std::printf("  \"objects\": %zu,\n", objectCount);
+	std::printf("  \"iterations\": %d,\n", iterations);
+#ifdef TRANSFORM_BATCH_SSE
+	std::printf("  \"simd\": \"sse2\",\n");
+#else
+	std::printf("  \"simd\": \"none\",\n");
+#endif
+	std::printf("  \"glm_ms\": %.4f,\n", glmMs);
+	std::printf("  \"batch_ms\": %.4f,\n", batchMs);
+	std::printf("  \"speedup\": %.2f,\n", batchMs > 0.0 ? glmMs / batchMs : 0.0);
+	std::printf("  \"max_relative_error\": %g\n", maxError);
+	std::printf("}\n");
+	std::fflush(stdout);
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <vector>
+
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "GLState.h"
+#include "MaterialArray.h"
+
+// ---------------
+// Uniform blocks shared by main.vsh and main.fsh
+// ---------------
+
+/**
+ * Binding points of the std140 uniform blocks. These have to stay in sync with the
+ * block names declared in the shaders (see BindUniformBlocks()).
+ */
+enum UniformBlockBinding : GLuint
+{
+	FRAME_BLOCK_BINDING = 0,	// FrameBlock  - data that changes once per frame
+	LIGHT_BLOCK_BINDING = 1,	// LightBlock  - global light, point lights go through ClusteredLighting.h
+	OBJECT_BLOCK_BINDING = 2	// ObjectBlock - per-object transforms
+};
+
+/**
+ * CPU mirror of the std140 FrameBlock.
+ * vec3 members are padded to 16 bytes, as std140 aligns them like a vec4.
+ */
+struct FrameBlock
+{
+	glm::mat4 viewProj;
+	glm::mat4 view;
+	glm::mat4 inverseViewProj;	// Rebuilds positions from the G-buffer depth
+	glm::vec3 cameraPos;	float pad0;
+	glm::vec4 clusterScale;		// See GetClusterScale()
+	glm::ivec4 clusterCount;	// Clusters along x, y and z, and the number of point lights
+};
+
+/**
+ * CPU mirror of the std140 LightBlock.
+ * The trailing float of each vec3 slot is used for scalars where std140 allows packing.
+ */
+struct LightBlock
+{
+	// Global
+	glm::vec3 ambient;		float pad0;
+	glm::vec3 diffuse;		float pad1;
+	glm::vec3 lightPos;		float pad2;
+	glm::vec3 specular;		float pad3;
+	glm::vec3 specComp;		float pad4;
+};
+
+/**
+ * CPU mirror of the std140 ObjectBlock.
+ * A std140 mat3 is stored as three vec4 columns.
+ */
+struct ObjectBlock
+{
+	glm::mat4 mvp;
+	glm::mat4 model;
+	glm::vec4 norm[3];
+	GLint layer;			// Layer of the material array
+	GLint pad0[3];
+};
+
+static_assert(sizeof(FrameBlock) == 240, "FrameBlock must match the std140 layout in the shaders");
+static_assert(sizeof(LightBlock) == 80, "LightBlock must match the std140 layout in the shaders");
+static_assert(sizeof(ObjectBlock) == 192, "ObjectBlock must match the std140 layout in the shaders");
+
+/**
+ * Struct containing the uniform buffer objects that back the uniform blocks
+ */
+struct UniformBuffers
+{
+	GLuint frame = 0;
+	GLuint light = 0;
+	GLuint object = 0;
+
+	// Per-object blocks are packed into a single buffer, each one starting at a
+	// multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	GLsizeiptr objectStride = 0;
+	GLsizeiptr objectCapacity = 0;
+	std::vector<unsigned char> objectStaging;
+};
+
+/**
+ * @brief Resolves the uniform block indices of a linked program and assigns them to their binding points.
+ * Also sets the sampler uniforms once, since they never change afterwards.
+ * @param[in] program OpenGL handle to the linked shader program
+ */
+inline void BindUniformBlocks(GLuint program)
+{
+	GLuint frameIndex = glGetUniformBlockIndex(program, "FrameBlock");
+	GLuint lightIndex = glGetUniformBlockIndex(program, "LightBlock");
+	GLuint objectIndex = glGetUniformBlockIndex(program, "ObjectBlock");
+
+	// Blocks that got optimized out of the program report GL_INVALID_INDEX
+	if (frameIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, frameIndex, FRAME_BLOCK_BINDING);
+	}
+	if (lightIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, lightIndex, LIGHT_BLOCK_BINDING);
+	}
+	if (objectIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, objectIndex, OBJECT_BLOCK_BINDING);
+	}
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "materials"), MATERIAL_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(program, "lightData"), LIGHT_DATA_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(program, "clusterGrid"), CLUSTER_GRID_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(program, "lightIndices"), LIGHT_INDEX_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(program, "gAlbedo"), GBUFFER_ALBEDO_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(program, "gNormal"), GBUFFER_NORMAL_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(program, "gDepth"), GBUFFER_DEPTH_TEXTURE_UNIT);
+	glUseProgram(0);
+}
+
+/**
+ * @brief Creates the uniform buffer objects and attaches the frame and light buffers to their binding points.
+ * @param[in] maxObjects Number of per-object blocks to reserve space for
+ * @return Struct containing the created buffers
+ */
+inline UniformBuffers CreateUniformBuffers(GLsizeiptr maxObjects)
+{
+	UniformBuffers buffers;
+
+	GLint offsetAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	buffers.objectStride = (sizeof(ObjectBlock) + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+	buffers.objectCapacity = maxObjects;
+	buffers.objectStaging.resize(static_cast<size_t>(buffers.objectStride * maxObjects));
+
+	glGenBuffers(1, &buffers.frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffers.frame);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &buffers.light);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffers.light);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), nullptr, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &buffers.object);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffers.object);
+	glBufferData(GL_UNIFORM_BUFFER, buffers.objectStride * maxObjects, nullptr, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, buffers.frame);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, buffers.light);
+
+	return buffers;
+}
+
+/**
+ * @brief Replaces the whole contents of a uniform buffer with a single upload.
+ * Respecifying the data store orphans the old one, so the driver does not wait for draws still reading it.
+ * @param[in,out] state State cache
+ * @param[in] buffer OpenGL handle to the uniform buffer
+ * @param[in] data Pointer to the new contents
+ * @param[in] size Size of the contents in bytes
+ */
+inline void UploadUniformBuffer(GLStateCache& state, GLuint buffer, const void* data, GLsizeiptr size)
+{
+	// The buffer stays bound, nothing else depends on the generic GL_UNIFORM_BUFFER binding
+	BindBuffer(state, GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+}
+
+/**
+ * @brief Builds the per-object block for a model matrix and stores it in the staging area.
+ * @param[in,out] buffers Uniform buffers owning the staging area
+ * @param[in] objectIndex Slot of the object in the per-object buffer
+ * @param[in] viewProj Combined projection and view matrix of the frame
+ * @param[in] model Model matrix of the object
+ * @param[in] layer Layer of the material array the object samples
+ */
+inline void StageObjectBlock(UniformBuffers& buffers, GLsizeiptr objectIndex, const glm::mat4& viewProj, const glm::mat4& model, GLint layer)
+{
+	ObjectBlock block;
+	block.mvp = viewProj * model;
+	block.model = model;
+
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	block.norm[0] = glm::vec4(normalMatrix[0], 0.0f);
+	block.norm[1] = glm::vec4(normalMatrix[1], 0.0f);
+	block.norm[2] = glm::vec4(normalMatrix[2], 0.0f);
+
+	block.layer = layer;
+
+	std::memcpy(&buffers.objectStaging[static_cast<size_t>(objectIndex * buffers.objectStride)], &block, sizeof(block));
+}
+
+/**
+ * @brief Uploads all staged per-object blocks with a single buffer update.
+ * @param[in,out] state State cache
+ * @param[in] buffers Uniform buffers owning the staging area
+ * @param[in] objectCount Number of staged objects
+ */
+inline void UploadObjectBlocks(GLStateCache& state, const UniformBuffers& buffers, GLsizeiptr objectCount)
+{
+	UploadUniformBuffer(state, buffers.object, buffers.objectStaging.data(), buffers.objectStride * objectCount);
+}
+
+/**
+ * @brief Points the ObjectBlock binding at the block of one object.
+ * @param[in,out] state State cache
+ * @param[in] buffers Uniform buffers owning the per-object buffer
+ * @param[in] objectIndex Slot of the object in the per-object buffer
+ */
+inline void BindObjectBlock(GLStateCache& state, const UniformBuffers& buffers, GLsizeiptr objectIndex)
+{
+	BindUniformBufferRange(state, OBJECT_BLOCK_BINDING, buffers.object, objectIndex * buffers.objectStride, sizeof(ObjectBlock));
+}
+
+/**
+ * @brief Deletes the uniform buffer objects.
+ * @param[in,out] buffers Uniform buffers to delete
+ */
+inline void DeleteUniformBuffers(UniformBuffers& buffers)
+{
+	glDeleteBuffers(1, &buffers.frame);
+	glDeleteBuffers(1, &buffers.light);
+	glDeleteBuffers(1, &buffers.object);
+	buffers = UniformBuffers();
+}
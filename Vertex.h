@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+/**
+ * Struct containing data about a vertex
+ */
+struct Vertex
+{
+	GLfloat x, y, z;	// Position
+	GLubyte r, g, b;	// Color
+	GLfloat u, v;		// UV coordinates
+	GLfloat nx, ny, nz; // Normal Vectors
+};
+
+/**
+ * Struct containing a vertex packed for the GPU, 20 bytes instead of the 36 of Vertex.
+ * Scene files and meshes on the CPU keep using Vertex; meshes are packed when uploaded.
+ */
+struct PackedVertex
+{
+	GLushort x, y, z, pad;	// Position, normalized across the bounds of the mesh
+	GLubyte r, g, b, a;		// Color, 4-byte aligned
+	GLhalf u, v;			// UV coordinates as half floats
+	GLuint normal;			// Normal as GL_INT_2_10_10_10_REV, w unused
+};
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must match the attribute offsets in SetVertexAttributes()");
+
+/**
+ * Layouts a mesh can store its vertices in on the GPU
+ */
+enum VertexLayout
+{
+	VERTEX_LAYOUT_FLOAT,	// Vertex as is
+	VERTEX_LAYOUT_PACKED	// PackedVertex, dequantized in the vertex shader
+};
+
+/**
+ * Ways a mesh can store its vertices on the GPU
+ */
+enum VertexStreams
+{
+	VERTEX_STREAMS_INTERLEAVED,	// One buffer holding whole vertices
+	VERTEX_STREAMS_SPLIT		// Positions in a buffer of their own, the other attributes interleaved in a second one
+};
+
+/**
+ * @brief Gets the size of one vertex on the GPU.
+ * @param[in] layout Layout of the vertices
+ * @return Size in bytes
+ */
+inline size_t GetVertexSize(VertexLayout layout)
+{
+	return layout == VERTEX_LAYOUT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+/**
+ * @brief Gets the size of the position of one vertex on the GPU, everything before its color.
+ * @param[in] layout Layout of the vertices
+ * @return Size in bytes
+ */
+inline size_t GetVertexPositionSize(VertexLayout layout)
+{
+	return layout == VERTEX_LAYOUT_PACKED ? offsetof(PackedVertex, r) : offsetof(Vertex, r);
+}
@@ -0,0 +1,10 @@
+// Uploaded once per frame, see FrameBlock in UniformBuffers.h
+layout(std140) uniform FrameBlock
+{
+	mat4 viewProj;
+	mat4 view;
+	mat4 inverseViewProj;
+	vec3 cameraPos;
+	vec4 clusterScale;	// xy: clusters per pixel, zw: scale and bias turning log(depth) into a slice
+	ivec4 clusterCount;	// xyz: clusters along each axis, w: number of point lights
+};
@@ -0,0 +1,15 @@
+// G-buffer read by the deferred lighting passes, see DeferredShading.h
+
+#include "octahedral.glsl"
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+// Rebuilds the world position of a pixel from its depth
+vec3 GetWorldPosition(ivec2 pixel, float depth)
+{
+	vec2 uv = (vec2(pixel) + 0.5) / vec2(textureSize(gDepth, 0));
+	vec4 world = inverseViewProj * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	return world.xyz / world.w;
+}
@@ -0,0 +1,71 @@
+// Lighting shared by the forward and the deferred renderer
+//
+// Feature defines, see ShaderPermutations.h:
+//   SPECULAR - adds the specular term, scaled by specularWeight. Without it the term is compiled out.
+
+layout(std140) uniform LightBlock
+{
+	// Global
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 lightPos;
+	vec3 specular;
+	vec3 specComp;
+};
+
+// Point lights, see ClusteredLighting.h
+uniform samplerBuffer lightData;	// 4 texels per light: position and radius, ambient and constant, diffuse and linear, specular and quadratic
+
+vec3 ShadeGlobalLight(vec3 position, vec3 norm, vec3 viewDir, vec3 texColor, float specularWeight)
+{
+	// Diffuse
+	vec3 lightDir = normalize(lightPos - position);
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 diffuseFinal = diffuse * diff * texColor;
+
+	// Ambient
+	vec3 ambientFinal = ambient * texColor;
+
+#ifdef SPECULAR
+	// Specular
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16);
+	vec3 specularFinal = specular * spec * specComp * specularWeight;
+
+	return ambientFinal + diffuseFinal + specularFinal;
+#else
+	return ambientFinal + diffuseFinal;
+#endif
+}
+
+vec3 ShadePointLight(int light, vec3 position, vec3 norm, vec3 viewDir, vec3 texColor, float specularWeight)
+{
+	vec4 positionRadius = texelFetch(lightData, light * 4);
+	vec4 ambientConstant = texelFetch(lightData, light * 4 + 1);
+	vec4 diffuseLinear = texelFetch(lightData, light * 4 + 2);
+	vec4 specularQuadratic = texelFetch(lightData, light * 4 + 3);
+
+	vec3 toLight = positionRadius.xyz - position;
+	float distance = length(toLight);
+	if (distance > positionRadius.w)
+	{
+		return vec3(0.0);
+	}
+
+	// Diffuse
+	vec3 lightDir = toLight / distance;
+	float diff = max(dot(norm, lightDir), 0.0);
+	vec3 result = ambientConstant.rgb * texColor + diffuseLinear.rgb * diff * texColor;
+
+#ifdef SPECULAR
+	// Specular
+	vec3 reflectDir = reflect(-lightDir, norm);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16);
+	result += specularQuadratic.rgb * spec * specularWeight;
+#endif
+
+	// Attenuation
+	float attenuation = 1.0 / (ambientConstant.w + diffuseLinear.w * distance + specularQuadratic.w * (distance * distance));
+
+	return result * attenuation;
+}